@@ -0,0 +1,198 @@
+#include "bench_util.h"
+#include "custom_allocator.h"
+#include "memory_pool.h"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace {
+
+const uint32_t SIZE_POOL = 1 << 28;
+
+MemoryPool<SIZE_POOL, 256> pool;
+MemoryPool<SIZE_POOL, 256, false, true> compact_pool;
+
+struct Pool {
+    static void* Alloc(uint32_t size) {
+        return pool.Alloc(size);
+    }
+
+    static void Free(void* p) {
+        pool.Free(p);
+    }
+};
+
+/* 8 byte headers on allocated blocks. */
+struct CompactPool {
+    static void* Alloc(uint32_t size) {
+        return compact_pool.Alloc(size);
+    }
+
+    static void Free(void* p) {
+        compact_pool.Free(p);
+    }
+};
+
+struct Malloc {
+    static void* Alloc(uint32_t size) {
+        return std::malloc(size);
+    }
+
+    static void Free(void* p) {
+        std::free(p);
+    }
+};
+
+/* Small deterministic generator, so that every allocator sees the same
+sequence of sizes and slots. */
+struct Lcg {
+    uint64_t state = 88172645463325252ull;
+
+    uint32_t Next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return (uint32_t)(state >> 33);
+    }
+};
+
+/* range(0) live blocks of one size; every iteration frees a random one and
+allocates its replacement. */
+template<class Allocator>
+void BM_FixedChurn(benchmark::State& state) {
+    std::vector<void*> live(state.range(0));
+    for (void*& p : live) {
+        p = Allocator::Alloc(32);
+    }
+
+    Lcg lcg;
+    for (auto _ : state) {
+        void*& p = live[lcg.Next() % live.size()];
+        Allocator::Free(p);
+        p = Allocator::Alloc(32);
+    }
+
+    for (void* p : live) {
+        Allocator::Free(p);
+    }
+    report_counters(state, 1);
+}
+
+/* Like BM_FixedChurn with sizes from 8 to 4096 bytes, skewed to small ones,
+which leaves holes of every size behind. */
+template<class Allocator>
+void BM_MixedFragmentation(benchmark::State& state) {
+    Lcg lcg;
+    auto next_size = [&lcg]() {
+        uint32_t r = lcg.Next();
+        return 8 + (r % 4 == 0 ? r % 4088 : r % 248);
+    };
+
+    std::vector<void*> live(state.range(0));
+    for (void*& p : live) {
+        p = Allocator::Alloc(next_size());
+    }
+
+    uint32_t num_failed = 0;
+    for (auto _ : state) {
+        void*& p = live[lcg.Next() % live.size()];
+        Allocator::Free(p);
+        p = Allocator::Alloc(next_size());
+        if (p == nullptr) {
+            num_failed++;
+        }
+    }
+
+    for (void* p : live) {
+        Allocator::Free(p);
+    }
+    report_counters(state, 1);
+    state.counters["failed"] = num_failed;
+}
+
+/* Allocate range(0) blocks of 64 bytes, then free them in reverse order. */
+template<class Allocator>
+void BM_LifoFree(benchmark::State& state) {
+    std::vector<void*> blocks(state.range(0));
+    for (auto _ : state) {
+        for (void*& p : blocks) {
+            p = Allocator::Alloc(64);
+        }
+        for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+            Allocator::Free(*it);
+        }
+    }
+    report_counters(state, 2 * blocks.size());
+}
+
+/* Allocate range(0) blocks of 64 bytes, then free them in the same order. */
+template<class Allocator>
+void BM_FifoFree(benchmark::State& state) {
+    std::vector<void*> blocks(state.range(0));
+    for (auto _ : state) {
+        for (void*& p : blocks) {
+            p = Allocator::Alloc(64);
+        }
+        for (void* p : blocks) {
+            Allocator::Free(p);
+        }
+    }
+    report_counters(state, 2 * blocks.size());
+}
+
+template<class Map>
+void BM_MapInsertErase(benchmark::State& state) {
+    const int num_keys = state.range(0);
+    for (auto _ : state) {
+        Map map;
+        for (int i = 0; i < num_keys; i++) {
+            map.emplace((i * 7919) % num_keys, i);
+        }
+        for (int i = 0; i < num_keys; i++) {
+            map.erase(i);
+        }
+        benchmark::DoNotOptimize(map);
+    }
+    report_counters(state, 2 * num_keys);
+}
+
+template<class List>
+void BM_ListPushPop(benchmark::State& state) {
+    const int num_values = state.range(0);
+    for (auto _ : state) {
+        List list;
+        for (int i = 0; i < num_values; i++) {
+            list.push_back(i);
+        }
+        while (!list.empty()) {
+            list.pop_front();
+        }
+        benchmark::DoNotOptimize(list);
+    }
+    report_counters(state, 2 * num_values);
+}
+
+const uint32_t CONTAINER_RESERVE = 1 << 24;
+
+using StdMap = std::map<int, int>;
+using CustomMap = std::map<int, int, std::less<int>, CustomAllocator<std::pair<const int, int>, CONTAINER_RESERVE>>;
+using StdList = std::list<int>;
+using CustomList = std::list<int, CustomAllocator<int, CONTAINER_RESERVE>>;
+
+}
+
+BENCHMARK_TEMPLATE(BM_FixedChurn, Malloc)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_FixedChurn, Pool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_FixedChurn, CompactPool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_MixedFragmentation, Malloc)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_MixedFragmentation, Pool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_MixedFragmentation, CompactPool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_LifoFree, Malloc)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_LifoFree, Pool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_LifoFree, CompactPool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_FifoFree, Malloc)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_FifoFree, Pool)->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_MapInsertErase, StdMap)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(BM_MapInsertErase, CustomMap)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(BM_ListPushPop, StdList)->Range(1 << 8, 1 << 16);
+BENCHMARK_TEMPLATE(BM_ListPushPop, CustomList)->Range(1 << 8, 1 << 16);
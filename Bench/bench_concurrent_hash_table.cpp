@@ -0,0 +1,91 @@
+#include "concurrent_hash_table.h"
+#include "hash_table.h"
+#include <benchmark/benchmark.h>
+#include <mutex>
+
+namespace {
+
+const uint32_t NUM_KEYS = 1 << 16;
+
+/* One HashTable behind a single lock, which is what sharing a HashTable
+between threads took before. */
+struct LockedTable {
+    HashTable<uint32_t> table;
+    std::mutex mutex;
+
+    bool Insert(uint32_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return table.Insert(uint32_t(value)) != table.end();
+    }
+
+    bool Contains(uint32_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return table.Search(value) != table.end();
+    }
+
+    bool Erase(uint32_t value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return table.Erase(table.Search(value));
+    }
+};
+
+struct ShardedTable {
+    ConcurrentHashTable<uint32_t> table;
+
+    bool Insert(uint32_t value) {
+        return table.Insert(uint32_t(value));
+    }
+
+    bool Contains(uint32_t value) {
+        return table.Contains(value);
+    }
+
+    bool Erase(uint32_t value) {
+        return table.Erase(value);
+    }
+};
+
+template<class Table>
+Table& shared_table() {
+    static Table table;
+    return table;
+}
+
+/* Every thread walks the keys with its own stride. One operation in
+WRITE_EVERY is an erase or insert of an odd key, the rest look up keys; the
+even keys are always present. */
+template<class Table, uint32_t WRITE_EVERY>
+void BM_Workload(benchmark::State& state) {
+    Table& table = shared_table<Table>();
+    if (state.thread_index() == 0) {
+        for (uint32_t i = 0; i < NUM_KEYS; i++) {
+            table.Insert(i);
+        }
+    }
+
+    uint32_t key = state.thread_index() * 7919;
+    uint32_t num_op = 0;
+    for (auto _ : state) {
+        key = (key + 40503) & (NUM_KEYS - 1);
+        if (WRITE_EVERY != 0 && ++num_op == WRITE_EVERY) {
+            num_op = 0;
+            if (!table.Erase(key | 1)) {
+                table.Insert(key | 1);
+            }
+        }
+        else {
+            benchmark::DoNotOptimize(table.Contains(key & ~1u));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+}
+
+BENCHMARK_TEMPLATE(BM_Workload, LockedTable, 0)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Workload, ShardedTable, 0)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Workload, LockedTable, 10)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Workload, ShardedTable, 10)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Workload, LockedTable, 2)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Workload, ShardedTable, 2)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,75 @@
+#include "concurrent_memory_pool.h"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <mutex>
+
+namespace {
+
+const uint32_t SIZE_POOL = 1 << 26;
+const int NUM_LIVE = 64;
+
+ConcurrentMemoryPool<SIZE_POOL> concurrent_pool;
+
+MemoryPool<SIZE_POOL, 256> locked_pool;
+std::mutex locked_pool_mutex;
+
+struct LockedPool {
+    void* Alloc(uint32_t size) {
+        std::lock_guard<std::mutex> lock(locked_pool_mutex);
+        return locked_pool.Alloc(size);
+    }
+
+    void Free(void* p) {
+        std::lock_guard<std::mutex> lock(locked_pool_mutex);
+        locked_pool.Free(p);
+    }
+};
+
+struct ConcurrentPool {
+    void* Alloc(uint32_t size) {
+        return concurrent_pool.Alloc(size);
+    }
+
+    void Free(void* p) {
+        concurrent_pool.Free(p);
+    }
+};
+
+struct Malloc {
+    void* Alloc(uint32_t size) {
+        return std::malloc(size);
+    }
+
+    void Free(void* p) {
+        std::free(p);
+    }
+};
+
+/* Every thread keeps a small window of live blocks of mixed small sizes and
+replaces one of them per iteration. */
+template<class Allocator>
+void BM_AllocFree(benchmark::State& state) {
+    Allocator alloc;
+    void* live[NUM_LIVE] = {};
+    uint32_t i = 0;
+
+    for (auto _ : state) {
+        uint32_t slot = i % NUM_LIVE;
+        alloc.Free(live[slot]);
+        live[slot] = alloc.Alloc(8 + (i * 7) % 120);
+        benchmark::DoNotOptimize(live[slot]);
+        i++;
+    }
+
+    for (void* p : live) {
+        alloc.Free(p);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+}
+
+BENCHMARK_TEMPLATE(BM_AllocFree, Malloc)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AllocFree, LockedPool)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_AllocFree, ConcurrentPool)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,491 @@
+#include "bench_util.h"
+#include "flat_hash_table.h"
+#include "frozen_hash_table.h"
+#include "hash_table.h"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> make_keys(int num_keys, const char* prefix) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < num_keys; i++) {
+        keys.push_back(prefix + std::to_string(i * 7919));
+    }
+    return keys;
+}
+
+template<class Table>
+void BM_Insert(benchmark::State& state) {
+    const std::vector<std::string> keys = make_keys(state.range(0), "key_");
+
+    for (auto _ : state) {
+        Table table;
+        for (const std::string& key : keys) {
+            table.Insert(std::string(key));
+        }
+        benchmark::DoNotOptimize(table);
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+/* Bulk load of long keys. With range(1) set the table is sized up front. */
+template<class Table>
+void BM_InsertLongKeys(benchmark::State& state) {
+    const std::vector<std::string> keys = make_keys(state.range(0), "a_rather_long_key_prefix_that_is_expensive_to_hash_");
+    const uint32_t capacity_hint = state.range(1) != 0 ? keys.size() : 0;
+
+    for (auto _ : state) {
+        Table table(capacity_hint);
+        for (const std::string& key : keys) {
+            table.Insert(std::string(key));
+        }
+        benchmark::DoNotOptimize(table);
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class Table>
+void BM_SearchHit(benchmark::State& state) {
+    const std::vector<std::string> keys = make_keys(state.range(0), "key_");
+    Table table;
+    for (const std::string& key : keys) {
+        table.Insert(std::string(key));
+    }
+
+    for (auto _ : state) {
+        for (const std::string& key : keys) {
+            benchmark::DoNotOptimize(table.Search(key));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template<class Table>
+void BM_SearchMiss(benchmark::State& state) {
+    const std::vector<std::string> keys = make_keys(state.range(0), "key_");
+    const std::vector<std::string> missing = make_keys(state.range(0), "miss_");
+    Table table;
+    for (const std::string& key : keys) {
+        table.Insert(std::string(key));
+    }
+
+    for (auto _ : state) {
+        for (const std::string& key : missing) {
+            benchmark::DoNotOptimize(table.Search(key));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * missing.size());
+}
+
+template<class Table>
+void BM_Iterate(benchmark::State& state) {
+    const std::vector<std::string> keys = make_keys(state.range(0), "key_");
+    Table table;
+    for (const std::string& key : keys) {
+        table.Insert(std::string(key));
+    }
+
+    for (auto _ : state) {
+        size_t total = 0;
+        for (const std::string& key : table) {
+            total += key.size();
+        }
+        benchmark::DoNotOptimize(total);
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+/* Iteration over range(1) ids left in a table that once held range(0). */
+template<class Table>
+void BM_IterateSparse(benchmark::State& state) {
+    const int num_keys = state.range(0);
+    const int num_left = state.range(1);
+    Table table;
+    for (int i = 0; i < num_keys; i++) {
+        table.Insert(int(i));
+    }
+    for (int i = num_left; i < num_keys; i++) {
+        table.Erase(table.Search(i));
+    }
+
+    for (auto _ : state) {
+        int64_t total = 0;
+        for (int value : table) {
+            total += value;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_left);
+    state.counters["capacity"] = table.Capacity();
+}
+
+/* Integer ids spaced by state.range(1), looked up after a bulk load. */
+template<class Table>
+void BM_SearchIds(benchmark::State& state) {
+    const int num_keys = state.range(0);
+    const int stride = state.range(1);
+    Table table;
+    for (int i = 0; i < num_keys; i++) {
+        table.Insert(i * stride);
+    }
+
+    for (auto _ : state) {
+        for (int i = 0; i < num_keys; i++) {
+            benchmark::DoNotOptimize(table.Search(i * stride));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+/* Lookups of a live set of range(0) ids after range(1) erase/insert cycles
+have turned the table over. The time per lookup should not depend on the
+number of cycles. */
+template<class Table>
+void BM_SearchAfterChurn(benchmark::State& state) {
+    const int num_keys = state.range(0);
+    const int num_cycles = state.range(1);
+    Table table;
+    for (int i = 0; i < num_keys; i++) {
+        table.Insert(int(i));
+    }
+    for (int i = num_keys; i < num_keys + num_cycles; i++) {
+        table.Erase(table.Search(i - num_keys));
+        table.Insert(int(i));
+    }
+
+    for (auto _ : state) {
+        for (int i = num_cycles; i < num_cycles + num_keys; i++) {
+            benchmark::DoNotOptimize(table.Search(i));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+    state.counters["capacity"] = table.Capacity();
+}
+
+/* Worst single Insert while building a table of range(0) ids from empty. */
+template<class Table>
+void BM_InsertTailLatency(benchmark::State& state) {
+    const int num_keys = state.range(0);
+    double max_ns = 0;
+
+    for (auto _ : state) {
+        Table table;
+        for (int i = 0; i < num_keys; i++) {
+            auto start = std::chrono::steady_clock::now();
+            table.Insert(int(i));
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (ns > max_ns) {
+                max_ns = ns;
+            }
+        }
+        benchmark::DoNotOptimize(table);
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+    state.counters["max_insert_ns"] = max_ns;
+}
+
+/* Lookups of range(0) present ids, one at a time or through SearchBatch. The
+cells are spread by the hash, so beyond the size of the last level cache
+nearly every lookup misses it. */
+template<class Table, bool BATCHED>
+void BM_SearchLarge(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    Table table(num_keys);
+    std::vector<uint64_t> keys;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        keys.push_back(i * 0x9E3779B97F4A7C15ull);
+        table.Insert(uint64_t(keys.back()));
+    }
+
+    std::vector<typename Table::iterator> results(num_keys, table.end());
+    for (auto _ : state) {
+        if (BATCHED) {
+            table.SearchBatch(keys.data(), num_keys, results.data());
+        }
+        else {
+            for (uint32_t i = 0; i < num_keys; i++) {
+                results[i] = table.Search(keys[i]);
+            }
+        }
+        benchmark::DoNotOptimize(results.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+/* Bulk load of range(0) ids into a table sized up front. */
+template<class Table, bool BATCHED>
+void BM_InsertLarge(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    std::vector<uint64_t> keys;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        keys.push_back(i * 0x9E3779B97F4A7C15ull);
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto p_table = std::make_unique<Table>(num_keys);
+        std::vector<uint64_t> values = keys;
+        state.ResumeTiming();
+
+        if (BATCHED) {
+            p_table->InsertBatch(values.data(), num_keys);
+        }
+        else {
+            for (uint32_t i = 0; i < num_keys; i++) {
+                p_table->Insert(std::move(values[i]));
+            }
+        }
+        benchmark::DoNotOptimize(p_table->Size());
+
+        state.PauseTiming();
+        p_table.reset();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+constexpr std::string_view KEYWORDS[] = {
+    "get", "set", "del", "exists", "expire", "ttl", "incr", "decr", "append", "strlen",
+    "lpush", "rpush", "lpop", "rpop", "llen", "lrange", "sadd", "srem", "smembers", "scard",
+    "hset", "hget", "hdel", "hkeys", "hvals", "zadd", "zrem", "zrange", "zscore", "ping"};
+
+constexpr auto FROZEN_KEYWORDS = MakeFrozenHashTable<std::string_view>({
+    "get", "set", "del", "exists", "expire", "ttl", "incr", "decr", "append", "strlen",
+    "lpush", "rpush", "lpop", "rpop", "llen", "lrange", "sadd", "srem", "smembers", "scard",
+    "hset", "hget", "hdel", "hkeys", "hvals", "zadd", "zrem", "zrange", "zscore", "ping"});
+
+/* Lookups of a fixed keyword set, half of them misses. */
+template<class Table>
+void BM_SearchKeywords(benchmark::State& state) {
+    const Table* p_table;
+    if constexpr (std::is_same_v<const Table, decltype(FROZEN_KEYWORDS)>) {
+        p_table = &FROZEN_KEYWORDS;
+    }
+    else {
+        static Table table;
+        if (table.Size() == 0) {
+            for (std::string_view keyword : KEYWORDS) {
+                table.Insert(std::string_view(keyword));
+            }
+        }
+        p_table = &table;
+    }
+
+    std::vector<std::string_view> queries;
+    for (std::string_view keyword : KEYWORDS) {
+        queries.push_back(keyword);
+        queries.push_back(keyword.substr(1));
+    }
+
+    for (auto _ : state) {
+        for (std::string_view query : queries) {
+            benchmark::DoNotOptimize(p_table->Search(query));
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+/* The tables of this repo and std::unordered_set behind one interface, for
+the size sweeps below. */
+template<class Table>
+struct IdSet {
+    Table table;
+
+    void Insert(uint64_t id) {
+        table.Insert(uint64_t(id));
+    }
+
+    bool Contains(uint64_t id) const {
+        return table.Search(id) != table.end();
+    }
+
+    void Erase(uint64_t id) {
+        table.Erase(table.Search(id));
+    }
+
+    uint32_t MaxProbeLength() const {
+        if constexpr (std::is_same_v<Table, HashTable<uint64_t>>) {
+            return table.MaxProbeLength();
+        }
+        else {
+            return 0;
+        }
+    }
+};
+
+template<>
+struct IdSet<std::unordered_set<uint64_t>> {
+    std::unordered_set<uint64_t> table;
+
+    void Insert(uint64_t id) {
+        table.insert(id);
+    }
+
+    bool Contains(uint64_t id) const {
+        return table.count(id) != 0;
+    }
+
+    void Erase(uint64_t id) {
+        table.erase(id);
+    }
+
+    uint32_t MaxProbeLength() const {
+        return 0;
+    }
+};
+
+uint64_t id_of(uint32_t i) {
+    return i * 0x9E3779B97F4A7C15ull;
+}
+
+/* Sweeps over range(0) ids, from tables that fit in L1 to ones far beyond
+the last level cache. Tables of this repo also report their longest probe
+sequence. */
+template<class Set>
+void BM_IdInsert(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    uint32_t max_probe = 0;
+    for (auto _ : state) {
+        Set set;
+        for (uint32_t i = 0; i < num_keys; i++) {
+            set.Insert(id_of(i));
+        }
+        state.PauseTiming();
+        max_probe = set.MaxProbeLength();
+        state.ResumeTiming();
+    }
+    report_counters(state, num_keys);
+    state.counters["max_probe"] = max_probe;
+}
+
+template<class Set>
+void BM_IdSearch(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    Set set;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        set.Insert(id_of(i));
+    }
+
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < num_keys; i++) {
+            benchmark::DoNotOptimize(set.Contains(id_of(i)));
+        }
+    }
+    report_counters(state, num_keys);
+    state.counters["max_probe"] = set.MaxProbeLength();
+}
+
+/* Erase every id, then put them back untimed. */
+template<class Set>
+void BM_IdErase(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    Set set;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        set.Insert(id_of(i));
+    }
+
+    for (auto _ : state) {
+        for (uint32_t i = 0; i < num_keys; i++) {
+            set.Erase(id_of(i));
+        }
+        state.PauseTiming();
+        for (uint32_t i = 0; i < num_keys; i++) {
+            set.Insert(id_of(i));
+        }
+        state.ResumeTiming();
+    }
+    report_counters(state, num_keys);
+    state.counters["max_probe"] = set.MaxProbeLength();
+}
+
+template<class Set>
+void BM_IdIterate(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    Set set;
+    for (uint32_t i = 0; i < num_keys; i++) {
+        set.Insert(id_of(i));
+    }
+
+    for (auto _ : state) {
+        uint64_t total = 0;
+        for (uint64_t id : set.table) {
+            total += id;
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    report_counters(state, num_keys);
+}
+
+using IdHashTable = IdSet<HashTable<uint64_t>>;
+using IdFlatHashTable = IdSet<FlatHashTable<uint64_t>>;
+using IdUnorderedSet = IdSet<std::unordered_set<uint64_t>>;
+
+using VariantTable = HashTable<std::string>;
+using StoredHashTable = HashTable<std::string, std::hash<std::string>, std::allocator<std::string>, true, true>;
+using MaskIdTable = HashTable<int>;
+using FlatIdTable = FlatHashTable<int>;
+using IncrementalIdTable = HashTable<int, std::hash<int>, std::allocator<int>, true, false, true>;
+using ModuloIdTable = HashTable<int, std::hash<int>, std::allocator<int>, false>;
+using FlatTable = FlatHashTable<std::string>;
+using LargeIdTable = HashTable<uint64_t>;
+using KeywordTable = HashTable<std::string_view>;
+using FrozenKeywordTable = std::remove_const_t<decltype(FROZEN_KEYWORDS)>;
+
+}
+
+BENCHMARK_TEMPLATE(BM_Insert, VariantTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_Insert, FlatTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_Insert, StoredHashTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_InsertLongKeys, VariantTable)->Ranges({{64, 1 << 16}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_InsertLongKeys, StoredHashTable)->Ranges({{64, 1 << 16}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_SearchHit, VariantTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_SearchHit, FlatTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_SearchHit, StoredHashTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_SearchMiss, VariantTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_SearchMiss, FlatTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_Iterate, VariantTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_Iterate, FlatTable)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_IterateSparse, MaskIdTable)->Args({1 << 20, 1 << 20})->Args({1 << 20, 1 << 10});
+BENCHMARK_TEMPLATE(BM_IterateSparse, FlatIdTable)->Args({1 << 20, 1 << 20})->Args({1 << 20, 1 << 10});
+BENCHMARK_TEMPLATE(BM_SearchIds, MaskIdTable)->Args({1 << 16, 1})->Args({1 << 16, 1024});
+BENCHMARK_TEMPLATE(BM_SearchIds, ModuloIdTable)->Args({1 << 16, 1})->Args({1 << 16, 1024});
+BENCHMARK_TEMPLATE(BM_SearchAfterChurn, MaskIdTable)->Args({1 << 12, 0})->Args({1 << 12, 1 << 20})->Args({1 << 12, 1 << 22});
+BENCHMARK_TEMPLATE(BM_SearchAfterChurn, FlatIdTable)->Args({1 << 12, 0})->Args({1 << 12, 1 << 20})->Args({1 << 12, 1 << 22});
+BENCHMARK_TEMPLATE(BM_InsertTailLatency, MaskIdTable)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_InsertTailLatency, IncrementalIdTable)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_SearchLarge, LargeIdTable, false)->Arg(1 << 16)->Arg(1 << 22)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SearchLarge, LargeIdTable, true)->Arg(1 << 16)->Arg(1 << 22)->Arg(1 << 24)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertLarge, LargeIdTable, false)->Arg(1 << 16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertLarge, LargeIdTable, true)->Arg(1 << 16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SearchKeywords, KeywordTable);
+BENCHMARK_TEMPLATE(BM_SearchKeywords, FrozenKeywordTable);
+BENCHMARK_TEMPLATE(BM_IdInsert, IdHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdInsert, IdFlatHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdInsert, IdUnorderedSet)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdSearch, IdHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdSearch, IdFlatHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdSearch, IdUnorderedSet)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdErase, IdHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdErase, IdFlatHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdErase, IdUnorderedSet)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdIterate, IdHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdIterate, IdFlatHashTable)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
+BENCHMARK_TEMPLATE(BM_IdIterate, IdUnorderedSet)->RangeMultiplier(16)->Range(1 << 8, 1 << 22);
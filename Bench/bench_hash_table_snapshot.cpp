@@ -0,0 +1,56 @@
+#include "hash_table_snapshot.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+/* Snapshot of range(0) ids, written once per size. */
+std::string snapshot_path(uint32_t num_keys) {
+    std::string path = "bench_snapshot_" + std::to_string(num_keys) + ".bin";
+    HashTable<uint64_t> table(num_keys);
+    for (uint32_t i = 0; i < num_keys; i++) {
+        table.Insert(i * 0x9E3779B97F4A7C15ull);
+    }
+    SaveHashTable(table, path.c_str());
+    return path;
+}
+
+/* Startup without a snapshot: every id goes through Insert. */
+void BM_StartInsert(benchmark::State& state) {
+    const uint32_t num_keys = state.range(0);
+    for (auto _ : state) {
+        HashTable<uint64_t> table;
+        for (uint32_t i = 0; i < num_keys; i++) {
+            table.Insert(i * 0x9E3779B97F4A7C15ull);
+        }
+        benchmark::DoNotOptimize(table.Size());
+    }
+}
+
+void BM_StartLoad(benchmark::State& state) {
+    const std::string path = snapshot_path(state.range(0));
+    for (auto _ : state) {
+        HashTable<uint64_t> table;
+        LoadHashTable(table, path.c_str());
+        benchmark::DoNotOptimize(table.Size());
+    }
+    remove(path.c_str());
+}
+
+/* Mapping and a first lookup, which faults in one page of the slots. */
+void BM_StartMap(benchmark::State& state) {
+    const std::string path = snapshot_path(state.range(0));
+    for (auto _ : state) {
+        MappedHashTable<uint64_t> table;
+        table.Open(path.c_str());
+        benchmark::DoNotOptimize(table.Search(0x9E3779B97F4A7C15ull));
+    }
+    remove(path.c_str());
+}
+
+}
+
+BENCHMARK(BM_StartInsert)->Arg(1 << 16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StartLoad)->Arg(1 << 16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StartMap)->Arg(1 << 16)->Arg(1 << 22)->Unit(benchmark::kMillisecond);
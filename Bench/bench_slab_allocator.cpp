@@ -0,0 +1,34 @@
+#include "custom_allocator.h"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+
+namespace {
+
+const uint32_t RESERVE_SIZE = 1 << 26;
+
+template<class Map>
+void BM_MapInsertErase(benchmark::State& state) {
+    const int num_keys = state.range(0);
+
+    for (auto _ : state) {
+        Map dict;
+        for (int i = 0; i < num_keys; i++) {
+            dict[i] = i;
+        }
+        for (int i = 0; i < num_keys; i++) {
+            dict.erase(i);
+        }
+        benchmark::DoNotOptimize(dict);
+    }
+
+    state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+using StdMap = std::map<int, int>;
+using PoolMap = std::map<int, int, std::less<int>, CustomAllocator<std::pair<const int, int>, RESERVE_SIZE>>;
+
+}
+
+BENCHMARK_TEMPLATE(BM_MapInsertErase, StdMap)->Range(64, 1 << 16);
+BENCHMARK_TEMPLATE(BM_MapInsertErase, PoolMap)->Range(64, 1 << 16);
@@ -0,0 +1,30 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+
+/* Resident set size of the process, read from /proc/self/statm. */
+inline double rss_megabytes() {
+    FILE* p_file = fopen("/proc/self/statm", "r");
+    if (p_file == nullptr)
+        return 0;
+
+    unsigned long num_pages_total = 0;
+    unsigned long num_pages_resident = 0;
+    if (fscanf(p_file, "%lu %lu", &num_pages_total, &num_pages_resident) != 2) {
+        num_pages_resident = 0;
+    }
+    fclose(p_file);
+    return (double)num_pages_resident * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+/* Counters shared by every benchmark: ops_per_iteration operations make up
+one iteration, and the time per operation is reported next to the RSS of the
+process at the end of the run. */
+inline void report_counters(benchmark::State& state, int64_t ops_per_iteration) {
+    state.SetItemsProcessed(state.iterations() * ops_per_iteration);
+    state.counters["time_per_op"] = benchmark::Counter((double)ops_per_iteration,
+                                                       benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    state.counters["rss_mb"] = rss_megabytes();
+}
@@ -0,0 +1,236 @@
+#pragma once
+#include "slab_allocator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/* Allocation traces: a binary log of the requests a pool served, recorded in
+production and replayed offline against other pool configurations (see
+Src/alloc_replay.cpp).
+
+A trace file is an AllocationTraceHeader followed by AllocationTraceEvents in
+the order they happened. Frees carry no size; the replay pairs them with
+their allocation by address. A failed allocation is logged with address 0. */
+struct AllocationTraceHeader {
+	char     magic[8];
+	uint32_t version;
+	uint32_t event_size;
+};
+
+struct AllocationTraceEvent {
+	/* Nanoseconds since the trace was opened. */
+	uint64_t timestamp;
+	uint64_t address;
+	uint32_t size;
+	/* Small index of the recording thread, in order of first event. */
+	uint16_t thread;
+	uint8_t  kind;
+	uint8_t  log2_alignment;
+};
+
+static const char     ALLOCATION_TRACE_MAGIC[8] = {'A', 'L', 'L', 'O', 'C', 'T', 'R', 0};
+static const uint32_t ALLOCATION_TRACE_VERSION = 1;
+static const uint8_t  ALLOCATION_TRACE_ALLOC = 1;
+static const uint8_t  ALLOCATION_TRACE_FREE = 2;
+
+/* Writes events to a trace file. Events are buffered and written under a lock
+BUFFER_EVENTS at a time, so recording from several threads is safe and costs
+little more than the lock. */
+class AllocationTrace {
+	static const uint32_t BUFFER_EVENTS = 4096;
+
+	FILE*                                 p_file;
+	std::mutex                            mutex;
+	std::chrono::steady_clock::time_point start;
+	uint32_t                              num_buffered;
+	bool                                  failed;
+	AllocationTraceEvent                  buffer[BUFFER_EVENTS];
+
+	static uint16_t thread_index() {
+		static std::atomic<uint16_t> num_threads(0);
+		thread_local uint16_t index = num_threads.fetch_add(1, std::memory_order_relaxed);
+		return index;
+	}
+
+	static uint8_t log2_of(uint32_t alignment) {
+		return alignment == 0 ? 0 : (uint8_t)__builtin_ctz(alignment);
+	}
+
+	void flush() {
+		if (num_buffered != 0 && fwrite(buffer, sizeof(AllocationTraceEvent), num_buffered, p_file) != num_buffered) {
+			failed = true;
+		}
+		num_buffered = 0;
+	}
+
+	void record(uint8_t kind, const void* p, uint32_t size, uint32_t alignment) {
+		uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		uint16_t thread = thread_index();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (p_file == nullptr)
+			return;
+
+		AllocationTraceEvent& event = buffer[num_buffered];
+		event.timestamp = timestamp;
+		event.address = (uint64_t)(uintptr_t)p;
+		event.size = size;
+		event.thread = thread;
+		event.kind = kind;
+		event.log2_alignment = log2_of(alignment);
+
+		if (++num_buffered == BUFFER_EVENTS) {
+			flush();
+		}
+	}
+
+public:
+	AllocationTrace() : p_file(nullptr), num_buffered(0), failed(false) {}
+
+	AllocationTrace(const AllocationTrace&) = delete;
+	AllocationTrace& operator = (const AllocationTrace&) = delete;
+
+	~AllocationTrace() {
+		Close();
+	}
+
+	/* Start a new trace at path, replacing the file. */
+	bool Open(const char* path) {
+		Close();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		p_file = fopen(path, "wb");
+		if (p_file == nullptr)
+			return false;
+
+		AllocationTraceHeader header = {};
+		memcpy(header.magic, ALLOCATION_TRACE_MAGIC, sizeof(header.magic));
+		header.version = ALLOCATION_TRACE_VERSION;
+		header.event_size = sizeof(AllocationTraceEvent);
+
+		failed = fwrite(&header, sizeof(header), 1, p_file) != 1;
+		start = std::chrono::steady_clock::now();
+		return !failed;
+	}
+
+	/* Write what is buffered and close the file. Returns false if any write
+	failed. */
+	bool Close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (p_file == nullptr)
+			return !failed;
+
+		flush();
+		if (fclose(p_file) != 0) {
+			failed = true;
+		}
+		p_file = nullptr;
+		return !failed;
+	}
+
+	bool IsOpen() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return p_file != nullptr;
+	}
+
+	void RecordAlloc(const void* p, uint32_t size, uint32_t alignment = 0) {
+		record(ALLOCATION_TRACE_ALLOC, p, size, alignment);
+	}
+
+	void RecordFree(const void* p) {
+		record(ALLOCATION_TRACE_FREE, p, 0, 0);
+	}
+};
+
+/* Read every event of the trace at path. Returns false if the file cannot
+be read or is not a trace; a trace cut short, e.g. by a crash, yields its
+complete events. */
+inline bool ReadAllocationTrace(const char* path, std::vector<AllocationTraceEvent>& events) {
+	FILE* p_file = fopen(path, "rb");
+	if (p_file == nullptr)
+		return false;
+
+	AllocationTraceHeader header;
+	bool ok = fread(&header, sizeof(header), 1, p_file) == 1 &&
+		memcmp(header.magic, ALLOCATION_TRACE_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == ALLOCATION_TRACE_VERSION &&
+		header.event_size == sizeof(AllocationTraceEvent);
+
+	if (ok) {
+		AllocationTraceEvent chunk[1024];
+		size_t num_read;
+		while ((num_read = fread(chunk, sizeof(AllocationTraceEvent), 1024, p_file)) != 0) {
+			events.insert(events.end(), chunk, chunk + num_read);
+		}
+		ok = ferror(p_file) == 0;
+	}
+
+	fclose(p_file);
+	return ok;
+}
+
+/* Pool that logs every request to an AllocationTrace before passing it on to
+Pool, e.g. as the pool of CustomAllocator or PoolAllocator. Nothing is logged
+while no trace is set. Behind CustomAllocator, single objects come from slabs
+carved out of the pool, so the trace shows the slab refills rather than every
+object. */
+template<class Pool>
+class TracedPool : public Pool {
+	AllocationTrace* p_trace = nullptr;
+
+public:
+	static const bool THREAD_SAFE = is_thread_safe_pool<Pool>::value;
+
+	using Pool::Pool;
+
+	/* The trace must stay alive until it is replaced or the pool is gone. */
+	void SetTrace(AllocationTrace* i_p_trace) {
+		p_trace = i_p_trace;
+	}
+
+	void* Alloc(uint32_t size) {
+		void* p = Pool::Alloc(size);
+		if (p_trace != nullptr) {
+			p_trace->RecordAlloc(p, size);
+		}
+		return p;
+	}
+
+	void* AllocAligned(uint32_t size, uint32_t alignment) {
+		void* p = Pool::AllocAligned(size, alignment);
+		if (p_trace != nullptr) {
+			p_trace->RecordAlloc(p, size, alignment);
+		}
+		return p;
+	}
+
+	void* Alloc(uint32_t size, std::align_val_t alignment) {
+		return AllocAligned(size, (uint32_t)alignment);
+	}
+
+	/* Logged as a free of the old block and an allocation of the new one,
+	even when the block stays in place. */
+	void* Realloc(void* p, uint32_t size) {
+		void* p_new = Pool::Realloc(p, size);
+		if (p_trace != nullptr && p_new != nullptr) {
+			if (p != nullptr) {
+				p_trace->RecordFree(p);
+			}
+			p_trace->RecordAlloc(p_new, size);
+		}
+		return p_new;
+	}
+
+	void Free(void* p) {
+		if (p_trace != nullptr && p != nullptr) {
+			p_trace->RecordFree(p);
+		}
+		Pool::Free(p);
+	}
+};
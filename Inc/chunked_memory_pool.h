@@ -0,0 +1,268 @@
+#pragma once
+#include "memory_pool.h"
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+
+/* Pool that grows on demand. Memory is mapped from the OS in chunks of
+CHUNK_SIZE bytes, each chunk managed by its own MemoryArena. A request that
+does not fit in a chunk gets a dedicated chunk rounded up to a multiple of
+CHUNK_SIZE. MAX_CHUNKS caps the number of mapped chunks, 0 means no cap.
+
+A chunk that becomes completely free is unmapped, so the resident size follows
+the working set. One empty chunk is kept as a spare, so that a workload going
+back and forth across a chunk boundary does not map and unmap every time.
+
+Chunks are aligned to CHUNK_SIZE, so Free finds the chunk of a block by
+masking its address. */
+template<uint32_t CHUNK_SIZE = (1 << 20), uint32_t MAX_CHUNKS = 0, uint32_t SIZE_CLASS_LIMIT = 0>
+class ChunkedMemoryPool {
+	using Arena = MemoryArena<SIZE_CLASS_LIMIT>;
+
+	struct Chunk {
+		Chunk* p_next_chunk;
+		Chunk* p_prev_chunk;
+		size_t size_mapping;
+		Arena  arena;
+
+		Chunk(size_t i_size_mapping, uint32_t size_info) : p_next_chunk(nullptr),
+														p_prev_chunk(nullptr),
+														size_mapping(i_size_mapping),
+														arena((uint8_t*)this + size_info, (uint32_t)(i_size_mapping - size_info)) {}
+	};
+
+public:
+	static const uint32_t SIZE_BLOCK_INFO = Arena::SIZE_BLOCK_INFO;
+	static const uint32_t SIZE_CHUNK_INFO = (sizeof(Chunk) + Arena::BYTE_ALIGNMENT_MASK) & ~Arena::BYTE_ALIGNMENT_MASK;
+
+	static_assert((CHUNK_SIZE & (CHUNK_SIZE - 1)) == 0, "Chunk size must be a power of two");
+	static_assert(CHUNK_SIZE >= 4096, "Chunk size must be at least a page");
+	static_assert(CHUNK_SIZE < (1u << 31), "Chunk size is too large");
+
+	ChunkedMemoryPool(const ChunkedMemoryPool&) = delete;
+	ChunkedMemoryPool(ChunkedMemoryPool&&) = delete;
+	ChunkedMemoryPool& operator = (const ChunkedMemoryPool&) = delete;
+	ChunkedMemoryPool& operator = (ChunkedMemoryPool&&) = delete;
+
+private:
+	Chunk*   p_chunks;
+	Chunk*   p_current_chunk;
+	Chunk*   p_spare_chunk;
+	uint32_t num_chunks;
+
+	/* Largest request that still fits in a regular chunk, with room for the
+	chunk header, the block header, alignment and the arena end marker. */
+	static const uint32_t MAX_SMALL_REQUEST = CHUNK_SIZE - SIZE_CHUNK_INFO - 3 * SIZE_BLOCK_INFO;
+
+	Chunk* map_chunk(size_t size_mapping) {
+		if (MAX_CHUNKS != 0 && num_chunks >= MAX_CHUNKS)
+			return nullptr;
+
+		/* Map one chunk more than needed and trim both ends, which leaves a
+		mapping aligned to CHUNK_SIZE. */
+		size_t size_reserved = size_mapping + CHUNK_SIZE;
+		void* p_reserved = mmap(nullptr, size_reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p_reserved == MAP_FAILED)
+			return nullptr;
+
+		uintptr_t reserved_begin = (uintptr_t)p_reserved;
+		uintptr_t chunk_begin = (reserved_begin + CHUNK_SIZE - 1) & ~(uintptr_t)(CHUNK_SIZE - 1);
+		uintptr_t chunk_end = chunk_begin + size_mapping;
+
+		if (chunk_begin != reserved_begin) {
+			munmap(p_reserved, chunk_begin - reserved_begin);
+		}
+		if (chunk_end != reserved_begin + size_reserved) {
+			munmap((void*)chunk_end, reserved_begin + size_reserved - chunk_end);
+		}
+
+		Chunk* p_chunk = new ((void*)chunk_begin) Chunk(size_mapping, SIZE_CHUNK_INFO);
+
+		p_chunk->p_next_chunk = p_chunks;
+		if (p_chunks != nullptr) {
+			p_chunks->p_prev_chunk = p_chunk;
+		}
+		p_chunks = p_chunk;
+		num_chunks++;
+
+		return p_chunk;
+	}
+
+	void unmap_chunk(Chunk* p_chunk) {
+		if (p_chunk->p_prev_chunk != nullptr) {
+			p_chunk->p_prev_chunk->p_next_chunk = p_chunk->p_next_chunk;
+		}
+		else {
+			p_chunks = p_chunk->p_next_chunk;
+		}
+
+		if (p_chunk->p_next_chunk != nullptr) {
+			p_chunk->p_next_chunk->p_prev_chunk = p_chunk->p_prev_chunk;
+		}
+
+		if (p_current_chunk == p_chunk) {
+			p_current_chunk = nullptr;
+		}
+		if (p_spare_chunk == p_chunk) {
+			p_spare_chunk = nullptr;
+		}
+
+		size_t size_mapping = p_chunk->size_mapping;
+		p_chunk->~Chunk();
+		munmap((void*)p_chunk, size_mapping);
+		num_chunks--;
+	}
+
+	static Chunk* chunk_of(void* p) {
+		return (Chunk*)((uintptr_t)p & ~(uintptr_t)(CHUNK_SIZE - 1));
+	}
+
+	void* alloc_from_chunk(Chunk* p_chunk, uint32_t wanted_size, uint32_t alignment) {
+		void* p_return = p_chunk->arena.AllocAligned(wanted_size, alignment);
+		if (p_return != nullptr) {
+			p_current_chunk = p_chunk;
+			if (p_spare_chunk == p_chunk) {
+				p_spare_chunk = nullptr;
+			}
+		}
+
+		return p_return;
+	}
+
+public:
+	ChunkedMemoryPool() : p_chunks(nullptr),
+						p_current_chunk(nullptr),
+						p_spare_chunk(nullptr),
+						num_chunks(0) {}
+
+	~ChunkedMemoryPool() {
+		while (p_chunks != nullptr) {
+			unmap_chunk(p_chunks);
+		}
+	}
+
+	void* Alloc(uint32_t wanted_size) {
+		return AllocAligned(wanted_size, Arena::BYTE_ALIGNMENT);
+	}
+
+	/* Alignments up to half a chunk are supported, so that an aligned block
+	always starts within the first CHUNK_SIZE bytes of its chunk. */
+	void* AllocAligned(uint32_t wanted_size, uint32_t alignment) {
+		void* p_return;
+
+		if (alignment > CHUNK_SIZE / 2)
+			return nullptr;
+
+		/* Worst case room needed in front of an aligned payload. */
+		uint32_t size_lead = alignment > Arena::BYTE_ALIGNMENT ? alignment + SIZE_BLOCK_INFO : 0;
+
+		if (wanted_size > MAX_SMALL_REQUEST - size_lead) {
+			size_t size_mapping = (size_t)wanted_size + size_lead + SIZE_CHUNK_INFO + 3 * SIZE_BLOCK_INFO;
+			size_mapping = (size_mapping + CHUNK_SIZE - 1) & ~(size_t)(CHUNK_SIZE - 1);
+			if (size_mapping >= Arena::ALLOC_FLAG)
+				return nullptr;
+
+			Chunk* p_chunk = map_chunk(size_mapping);
+			if (p_chunk == nullptr)
+				return nullptr;
+
+			return p_chunk->arena.AllocAligned(wanted_size, alignment);
+		}
+
+		/* The chunk that served the last request is the most likely to have
+		room, then every other chunk is tried before the pool grows. Dedicated
+		chunks are skipped: a block past their first CHUNK_SIZE bytes could not
+		be found again by masking. */
+		if (p_current_chunk != nullptr) {
+			p_return = alloc_from_chunk(p_current_chunk, wanted_size, alignment);
+			if (p_return != nullptr)
+				return p_return;
+		}
+
+		for (Chunk* p_chunk = p_chunks; p_chunk != nullptr; p_chunk = p_chunk->p_next_chunk) {
+			if (p_chunk == p_current_chunk || p_chunk->size_mapping != CHUNK_SIZE ||
+				p_chunk->arena.GetFreeBytes() < wanted_size)
+				continue;
+
+			p_return = alloc_from_chunk(p_chunk, wanted_size, alignment);
+			if (p_return != nullptr)
+				return p_return;
+		}
+
+		Chunk* p_chunk = map_chunk(CHUNK_SIZE);
+		if (p_chunk == nullptr)
+			return nullptr;
+
+		return alloc_from_chunk(p_chunk, wanted_size, alignment);
+	}
+
+	void Free(void* p) {
+		if (p == nullptr)
+			return;
+
+		Chunk* p_chunk = chunk_of(p);
+		p_chunk->arena.Free(p);
+
+		if (p_chunk->arena.GetAllocatedBlocks() != 0)
+			return;
+
+		/* The chunk is idle. Dedicated chunks always go back to the OS, a
+		regular one is kept if there is no spare yet. */
+		if (p_chunk->size_mapping == CHUNK_SIZE && p_spare_chunk == nullptr) {
+			p_spare_chunk = p_chunk;
+			return;
+		}
+
+		unmap_chunk(p_chunk);
+	}
+
+	/* Blocks only grow within their own chunk. */
+	bool TryExpand(void* p, uint32_t new_size) {
+		return chunk_of(p)->arena.TryExpand(p, new_size);
+	}
+
+	void Shrink(void* p, uint32_t new_size) {
+		chunk_of(p)->arena.Shrink(p, new_size);
+	}
+
+	/* Resize in place when the chunk allows it, otherwise move the block to
+	wherever Alloc finds room. */
+	void* Realloc(void* p, uint32_t new_size) {
+		if (p == nullptr)
+			return Alloc(new_size);
+
+		uint32_t size_block = GetBlockSize(p);
+		if (new_size <= size_block) {
+			Shrink(p, new_size);
+			return p;
+		}
+
+		if (TryExpand(p, new_size))
+			return p;
+
+		void* p_return = Alloc(new_size);
+		if (p_return != nullptr) {
+			memcpy(p_return, p, size_block);
+			Free(p);
+		}
+
+		return p_return;
+	}
+
+	size_t GetFreeBytes() const {
+		size_t free_bytes = 0;
+		for (Chunk* p_chunk = p_chunks; p_chunk != nullptr; p_chunk = p_chunk->p_next_chunk) {
+			free_bytes += p_chunk->arena.GetFreeBytes();
+		}
+
+		return free_bytes;
+	}
+
+	uint32_t GetNumChunks() const {
+		return num_chunks;
+	}
+
+	static uint32_t GetBlockSize(const void* p) {
+		return Arena::GetBlockSize(p);
+	}
+};
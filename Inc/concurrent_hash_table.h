@@ -0,0 +1,149 @@
+#pragma once
+#include "hash_table.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <type_traits>
+
+/* HashTable that may be shared between threads. Values are spread over
+SHARD_COUNT independent HashTables by the top bits of their hash, and every
+shard has its own reader/writer lock: lookups of one shard run in parallel,
+and writers only block the threads that touch the same shard.
+
+Each shard gets its own copy of the allocator. The allocator passed to the
+constructor may also be a function of the shard index returning one, so that
+every shard draws from its own pool. Such a pool is only used under the lock
+of its shard and need not be thread safe, e.g. PoolAllocator over a
+MemoryPool. CustomAllocator shares one static pool between all shards, so it
+needs a thread safe pool such as ConcurrentMemoryPool. */
+template<class T, class Hash = std::hash<T>, class Allocator = std::allocator<T>, uint32_t SHARD_COUNT = 16>
+class ConcurrentHashTable {
+    static_assert(SHARD_COUNT != 0 && (SHARD_COUNT & (SHARD_COUNT - 1)) == 0, "Shard count must be a power of two");
+
+    using Table = HashTable<T, Hash, Allocator>;
+
+    static const uint32_t CACHE_LINE = 64;
+
+    /* Shards sit on their own cache lines, so that taking the lock of one
+    does not slow down the threads using its neighbours. */
+    struct alignas(CACHE_LINE) Shard {
+        mutable std::shared_mutex mutex;
+        Table                     table;
+
+        explicit Shard(const Allocator& allocator) : table(allocator) {}
+    };
+
+    alignas(Shard) unsigned char shards_storage[SHARD_COUNT * sizeof(Shard)];
+
+    Shard& shard(uint32_t idx) {
+        return ((Shard*)shards_storage)[idx];
+    }
+
+    const Shard& shard(uint32_t idx) const {
+        return ((const Shard*)shards_storage)[idx];
+    }
+
+    /* The tables index their cells by the low bits of the hash, so the shard
+    is taken from the top bits of a different mix of it. */
+    static uint32_t shard_index(const T& value) {
+        if constexpr (SHARD_COUNT == 1) {
+            return 0;
+        }
+        else {
+            uint64_t h = (uint64_t)Hash{}(value) * 0x9E3779B97F4A7C15ull;
+            return (uint32_t)(h >> (64 - __builtin_ctz(SHARD_COUNT)));
+        }
+    }
+
+public:
+    ConcurrentHashTable() : ConcurrentHashTable(Allocator()) {}
+
+    explicit ConcurrentHashTable(const Allocator& allocator) : ConcurrentHashTable([&](uint32_t) {
+                                                                   return allocator;
+                                                               }) {}
+
+    template<class MakeAllocator,
+        class = std::enable_if_t<std::is_invocable_r_v<Allocator, MakeAllocator, uint32_t>>>
+    explicit ConcurrentHashTable(MakeAllocator make_allocator) {
+        uint32_t idx = 0;
+        try {
+            for (; idx < SHARD_COUNT; idx++) {
+                new (&shard(idx)) Shard(make_allocator(idx));
+            }
+        }
+        catch (...) {
+            while (idx != 0) {
+                shard(--idx).~Shard();
+            }
+            throw;
+        }
+    }
+
+    ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+    ConcurrentHashTable& operator = (const ConcurrentHashTable&) = delete;
+
+    ~ConcurrentHashTable() {
+        for (uint32_t idx = 0; idx < SHARD_COUNT; idx++) {
+            shard(idx).~Shard();
+        }
+    }
+
+    /* Returns false if the value is present already. */
+    bool Insert(T&& value) {
+        Shard& s = shard(shard_index(value));
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        return s.table.Insert(std::move(value)) != s.table.end();
+    }
+
+    bool Contains(const T& value) const {
+        const Shard& s = shard(shard_index(value));
+        std::shared_lock<std::shared_mutex> lock(s.mutex);
+        return s.table.Search(value) != s.table.end();
+    }
+
+    bool Erase(const T& value) {
+        Shard& s = shard(shard_index(value));
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        return s.table.Erase(s.table.Search(value));
+    }
+
+    /* Call f for every value, one shard at a time under its reader lock. The
+    shards are not locked together, so values inserted or erased meanwhile
+    may or may not be seen. */
+    template<class F>
+    void ForEach(F f) const {
+        for (uint32_t idx = 0; idx < SHARD_COUNT; idx++) {
+            std::shared_lock<std::shared_mutex> lock(shard(idx).mutex);
+            for (const T& value : shard(idx).table) {
+                f(value);
+            }
+        }
+    }
+
+    /* Room for about num_values, assuming they spread evenly over the shards. */
+    void Reserve(uint32_t num_values) {
+        for (uint32_t idx = 0; idx < SHARD_COUNT; idx++) {
+            std::unique_lock<std::shared_mutex> lock(shard(idx).mutex);
+            shard(idx).table.Reserve(num_values / SHARD_COUNT + 1);
+        }
+    }
+
+    void Clear() {
+        for (uint32_t idx = 0; idx < SHARD_COUNT; idx++) {
+            std::unique_lock<std::shared_mutex> lock(shard(idx).mutex);
+            shard(idx).table.Clear();
+        }
+    }
+
+    /* Exact only while no other thread changes the table. */
+    uint32_t Size() const {
+        uint32_t size = 0;
+        for (uint32_t idx = 0; idx < SHARD_COUNT; idx++) {
+            std::shared_lock<std::shared_mutex> lock(shard(idx).mutex);
+            size += shard(idx).table.Size();
+        }
+        return size;
+    }
+};
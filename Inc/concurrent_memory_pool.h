@@ -0,0 +1,271 @@
+#pragma once
+#include "memory_pool.h"
+#include <atomic>
+#include <mutex>
+
+/* Thread safe front end for MemoryPool. Every thread keeps its own cache of
+free blocks per size class and only takes the pool lock to refill or drain a
+whole batch of blocks at once. A batch is BATCH_SIZE blocks, but never much
+more than BATCH_BYTES, so that caches of large classes stay small. Requests
+larger than SIZE_CLASS_LIMIT go straight to the shared pool under the lock.
+
+Blocks parked in a thread cache are counted as allocated by GetFreeBytes. They
+are given back to the pool when the thread exits. */
+template<uint32_t SIZE_POOL, uint32_t SIZE_CLASS_LIMIT = 256, uint32_t BATCH_SIZE = 32, uint32_t BATCH_BYTES = 1024>
+class ConcurrentMemoryPool {
+	using Pool = MemoryPool<SIZE_POOL, SIZE_CLASS_LIMIT>;
+
+	static const uint32_t BYTE_ALIGNMENT = Pool::BYTE_ALIGNMENT;
+	static const uint32_t SIZE_CLASS_COUNT = Pool::SIZE_CLASS_COUNT;
+
+	static_assert(SIZE_CLASS_COUNT != 0, "Thread caches need at least one size class");
+	static_assert(BATCH_SIZE != 0, "Batch size must not be zero");
+
+	/* Free blocks in a thread cache are linked through their payload. */
+	struct FreeObject {
+		FreeObject* p_next;
+	};
+
+	struct ThreadCache {
+		std::atomic<ConcurrentMemoryPool*> p_owner;
+		ThreadCache* p_next_in_thread;
+		ThreadCache* p_next_in_pool;
+		FreeObject*  lists[SIZE_CLASS_COUNT];
+		uint32_t     counts[SIZE_CLASS_COUNT];
+
+		explicit ThreadCache(ConcurrentMemoryPool* p_pool) : p_owner(p_pool),
+															p_next_in_thread(nullptr),
+															p_next_in_pool(nullptr),
+															lists(),
+															counts() {}
+	};
+
+	/* All caches created by one thread, most recently used first. */
+	struct ThreadCacheList {
+		ThreadCache* p_head = nullptr;
+
+		~ThreadCacheList() {
+			while (p_head != nullptr) {
+				ThreadCache* p_cache = p_head;
+				p_head = p_cache->p_next_in_thread;
+
+				std::lock_guard<std::mutex> lock(registry_mutex());
+				ConcurrentMemoryPool* p_pool = p_cache->p_owner.load(std::memory_order_relaxed);
+				if (p_pool != nullptr) {
+					p_pool->release_cache(p_cache);
+				}
+				delete p_cache;
+			}
+		}
+	};
+
+	static thread_local ThreadCacheList thread_caches;
+
+	/* Guards the links between pools and thread caches, so that a thread exit
+	and a pool destruction never race on the same cache. */
+	static std::mutex& registry_mutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	Pool         pool;
+	std::mutex   pool_mutex;
+	ThreadCache* p_registered_caches;
+
+	static uint32_t size_class_index(uint32_t size) {
+		return (size + BYTE_ALIGNMENT - 1) / BYTE_ALIGNMENT - 1;
+	}
+
+	static uint32_t batch_size(uint32_t idx) {
+		uint32_t count = BATCH_BYTES / ((idx + 1) * BYTE_ALIGNMENT);
+		if (count > BATCH_SIZE)
+			return BATCH_SIZE;
+		return count < 2 ? 2 : count;
+	}
+
+	ThreadCache* get_cache() {
+		ThreadCacheList& thread_list = thread_caches;
+		ThreadCache* p_prev = nullptr;
+		ThreadCache* p_cache = thread_list.p_head;
+
+		while (p_cache != nullptr && p_cache->p_owner.load(std::memory_order_relaxed) != this) {
+			p_prev = p_cache;
+			p_cache = p_cache->p_next_in_thread;
+		}
+
+		if (p_cache == nullptr) {
+			p_cache = new ThreadCache(this);
+
+			std::lock_guard<std::mutex> lock(registry_mutex());
+			p_cache->p_next_in_pool = p_registered_caches;
+			p_registered_caches = p_cache;
+		}
+		else if (p_prev != nullptr) {
+			p_prev->p_next_in_thread = p_cache->p_next_in_thread;
+		}
+		else {
+			return p_cache;
+		}
+
+		/* Keep the cache of the pool used last at the front. */
+		p_cache->p_next_in_thread = thread_list.p_head;
+		thread_list.p_head = p_cache;
+		return p_cache;
+	}
+
+	void refill(ThreadCache* p_cache, uint32_t idx) {
+		const uint32_t size = (idx + 1) * BYTE_ALIGNMENT;
+
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		for (uint32_t i = batch_size(idx); i != 0; i--) {
+			FreeObject* p_object = (FreeObject*)pool.Alloc(size);
+			if (p_object == nullptr)
+				break;
+
+			p_object->p_next = p_cache->lists[idx];
+			p_cache->lists[idx] = p_object;
+			p_cache->counts[idx]++;
+		}
+	}
+
+	/* Return up to max_count blocks of one size class to the pool. The pool
+	lock must be held. */
+	void drain(ThreadCache* p_cache, uint32_t idx, uint32_t max_count) {
+		while (max_count-- != 0 && p_cache->lists[idx] != nullptr) {
+			FreeObject* p_object = p_cache->lists[idx];
+			p_cache->lists[idx] = p_object->p_next;
+			p_cache->counts[idx]--;
+			pool.Free(p_object);
+		}
+	}
+
+	void drain_all(ThreadCache* p_cache) {
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		for (uint32_t idx = 0; idx < SIZE_CLASS_COUNT; idx++) {
+			drain(p_cache, idx, p_cache->counts[idx]);
+		}
+	}
+
+	/* Called with the registry lock held when a thread exits. */
+	void release_cache(ThreadCache* p_cache) {
+		drain_all(p_cache);
+
+		ThreadCache** pp_link = &p_registered_caches;
+		while (*pp_link != p_cache) {
+			pp_link = &(*pp_link)->p_next_in_pool;
+		}
+		*pp_link = p_cache->p_next_in_pool;
+	}
+
+public:
+	static const bool THREAD_SAFE = true;
+
+	ConcurrentMemoryPool() : p_registered_caches(nullptr) {}
+
+	~ConcurrentMemoryPool() {
+		/* The cached blocks live in this pool, so they simply go away with it.
+		The caches are freed by their threads. */
+		std::lock_guard<std::mutex> lock(registry_mutex());
+		for (ThreadCache* p_cache = p_registered_caches; p_cache != nullptr; p_cache = p_cache->p_next_in_pool) {
+			p_cache->p_owner.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	ConcurrentMemoryPool(const ConcurrentMemoryPool&) = delete;
+	ConcurrentMemoryPool(ConcurrentMemoryPool&&) = delete;
+	ConcurrentMemoryPool& operator = (const ConcurrentMemoryPool&) = delete;
+	ConcurrentMemoryPool& operator = (ConcurrentMemoryPool&&) = delete;
+
+	void* Alloc(uint32_t wanted_size) {
+		if (wanted_size == 0 || wanted_size > SIZE_CLASS_LIMIT) {
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			return pool.Alloc(wanted_size);
+		}
+
+		uint32_t idx = size_class_index(wanted_size);
+		ThreadCache* p_cache = get_cache();
+
+		if (p_cache->lists[idx] == nullptr) {
+			refill(p_cache, idx);
+
+			/* The pool may be exhausted while this thread still holds blocks
+			of other sizes. Give them back so they can be merged and retry. */
+			if (p_cache->lists[idx] == nullptr) {
+				drain_all(p_cache);
+				refill(p_cache, idx);
+				if (p_cache->lists[idx] == nullptr)
+					return nullptr;
+			}
+		}
+
+		FreeObject* p_object = p_cache->lists[idx];
+		p_cache->lists[idx] = p_object->p_next;
+		p_cache->counts[idx]--;
+		return p_object;
+	}
+
+	/* Aligned requests bypass the thread caches. Once freed the block is an
+	ordinary block of its size and may be cached like any other. */
+	void* AllocAligned(uint32_t wanted_size, uint32_t alignment) {
+		if (alignment <= BYTE_ALIGNMENT)
+			return Alloc(wanted_size);
+
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		return pool.AllocAligned(wanted_size, alignment);
+	}
+
+	void Free(void* p) {
+		if (p == nullptr)
+			return;
+
+		uint32_t size = Pool::GetBlockSize(p);
+		if (size == 0 || size > SIZE_CLASS_LIMIT || (size % BYTE_ALIGNMENT) != 0) {
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			pool.Free(p);
+			return;
+		}
+
+		uint32_t idx = size_class_index(size);
+		ThreadCache* p_cache = get_cache();
+
+		FreeObject* p_object = (FreeObject*)p;
+		p_object->p_next = p_cache->lists[idx];
+		p_cache->lists[idx] = p_object;
+		p_cache->counts[idx]++;
+
+		/* Keep the cache bounded, the surplus goes back in one batch. */
+		if (p_cache->counts[idx] > 2 * batch_size(idx)) {
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			drain(p_cache, idx, batch_size(idx));
+		}
+	}
+
+	/* Resizing always takes the pool lock. A block moved by Realloc comes
+	from the shared pool, not from a thread cache. */
+	bool TryExpand(void* p, uint32_t new_size) {
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		return pool.TryExpand(p, new_size);
+	}
+
+	void Shrink(void* p, uint32_t new_size) {
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		pool.Shrink(p, new_size);
+	}
+
+	void* Realloc(void* p, uint32_t new_size) {
+		if (p == nullptr)
+			return Alloc(new_size);
+
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		return pool.Realloc(p, new_size);
+	}
+
+	uint32_t GetFreeBytes() {
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		return pool.GetFreeBytes();
+	}
+};
+
+template<uint32_t SIZE_POOL, uint32_t SIZE_CLASS_LIMIT, uint32_t BATCH_SIZE, uint32_t BATCH_BYTES>
+thread_local typename ConcurrentMemoryPool<SIZE_POOL, SIZE_CLASS_LIMIT, BATCH_SIZE, BATCH_BYTES>::ThreadCacheList
+	ConcurrentMemoryPool<SIZE_POOL, SIZE_CLASS_LIMIT, BATCH_SIZE, BATCH_BYTES>::thread_caches;
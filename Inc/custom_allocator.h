@@ -1,36 +1,87 @@
+#pragma once
 #include "memory_pool.h"
+#include "slab_allocator.h"
+#include <new>
+#include <type_traits>
 #include <utility>
 
-template<typename T, uint32_t RESERVE_SIZE = 0xFFFF>
+/* Node based containers hand out many blocks of one size, so the pool keeps
+freed small blocks on its size class lists. */
+static const uint32_t CUSTOM_ALLOCATOR_SIZE_CLASS_LIMIT = 256;
+
+/* Pool is the type of the static pool behind the allocator. Anything with
+Alloc/AllocAligned/Free works, e.g. ConcurrentMemoryPool<RESERVE_SIZE> to share the
+allocator between threads or ChunkedMemoryPool<> to grow on demand.
+
+Single object requests, which is all node based containers make, are served
+from a SlabPool of sizeof(T) objects on top of the pool, without a block
+header per object. Pools shared between threads are used directly. */
+template<typename T, uint32_t RESERVE_SIZE = 0xFFFF,
+	class Pool = MemoryPool<RESERVE_SIZE, CUSTOM_ALLOCATOR_SIZE_CLASS_LIMIT>>
 struct CustomAllocator {
 private:
-	static MemoryPool<RESERVE_SIZE> mem_pool;
+	static const bool USE_SLABS = !is_thread_safe_pool<Pool>::value;
+
+	/* One object, so the slabs are always released before the pool goes away. */
+	struct PoolResource {
+		Pool mem_pool;
+		SlabPool<sizeof(T), alignof(T), Pool> slab_pool;
+
+		PoolResource() : slab_pool(mem_pool) {}
+	};
+
+	static PoolResource resource;
 public:
 	using value_type = T;	
 
 	template<typename U>
 	struct rebind {
-		using other = CustomAllocator<U>;
+		using other = CustomAllocator<U, RESERVE_SIZE, Pool>;
 	};
 
+	/* The pool shared by every allocator of this type, e.g. for its GetStats
+	or to set the trace of a TracedPool. */
+	static Pool& GetPool() {
+		return resource.mem_pool;
+	}
+
 	CustomAllocator() = default;	
 	~CustomAllocator() = default;
 
-	CustomAllocator(const CustomAllocator<T, RESERVE_SIZE>&) {
+	CustomAllocator(const CustomAllocator<T, RESERVE_SIZE, Pool>&) {
 
 	}
 
 	template<typename U>
-	CustomAllocator(const CustomAllocator<U>&) {
+	CustomAllocator(const CustomAllocator<U, RESERVE_SIZE, Pool>&) {
 
 	}
 
 	T *allocate(std::size_t n) {
-		return (T*)(mem_pool.Alloc(n * sizeof(T)));
+		if (n > UINT32_MAX / sizeof(T))
+			throw std::bad_alloc();
+
+		T* p;
+		if (USE_SLABS && n == 1) {
+			p = (T*)(resource.slab_pool.Alloc());
+		}
+		else {
+			p = (T*)(resource.mem_pool.AllocAligned(n * sizeof(T), alignof(T)));
+		}
+
+		if (p == nullptr)
+			throw std::bad_alloc();
+
+		return p;
 	}
 
 	void deallocate(T *p, std::size_t n) {
-		mem_pool.Free(p);
+		if (USE_SLABS && n == 1) {
+			resource.slab_pool.Free(p);
+		}
+		else {
+			resource.mem_pool.Free(p);
+		}
 	}
 
 	void construct(T *p, const T& val) {
@@ -52,5 +103,67 @@ public:
 	}
 };
 
-template<typename T, uint32_t RESERVE_SIZE>
-MemoryPool<RESERVE_SIZE> CustomAllocator<T, RESERVE_SIZE>:: mem_pool;
\ No newline at end of file
+template<typename T, uint32_t RESERVE_SIZE, class Pool>
+typename CustomAllocator<T, RESERVE_SIZE, Pool>::PoolResource CustomAllocator<T, RESERVE_SIZE, Pool>:: resource;
+/* Stateful counterpart of CustomAllocator: it holds a pointer to a pool owned
+by the caller. Rebound copies keep the pointer, so a container and all of its
+internal node types draw from the same pool, and the pointer follows the
+container on copy assignment, move assignment and swap. Allocators compare
+equal when they share a pool. */
+template<typename T, class Pool>
+struct PoolAllocator {
+private:
+	Pool* p_pool;
+
+	template<typename U, class OtherPool>
+	friend struct PoolAllocator;
+public:
+	using value_type = T;
+
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	template<typename U>
+	struct rebind {
+		using other = PoolAllocator<U, Pool>;
+	};
+
+	explicit PoolAllocator(Pool& pool) : p_pool(&pool) {}
+
+	PoolAllocator(const PoolAllocator&) = default;
+	PoolAllocator& operator = (const PoolAllocator&) = default;
+
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U, Pool>& other) : p_pool(other.p_pool) {}
+
+	T *allocate(std::size_t n) {
+		if (n > UINT32_MAX / sizeof(T))
+			throw std::bad_alloc();
+
+		T* p = (T*)(p_pool->AllocAligned(n * sizeof(T), alignof(T)));
+		if (p == nullptr)
+			throw std::bad_alloc();
+
+		return p;
+	}
+
+	void deallocate(T *p, std::size_t) {
+		p_pool->Free(p);
+	}
+
+	Pool& GetPool() const {
+		return *p_pool;
+	}
+
+	template<typename U>
+	bool operator==(const PoolAllocator<U, Pool>& other) const {
+		return p_pool == other.p_pool;
+	}
+
+	template<typename U>
+	bool operator!=(const PoolAllocator<U, Pool>& other) const {
+		return p_pool != other.p_pool;
+	}
+};
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Open addressing hash set with the same interface as HashTable, laid out
+like a SwissTable. Every slot has a one byte control word in a separate
+array: EMPTY, DELETED, or the low 7 bits of the hash of the value stored in
+it. A lookup scans the control words of a group of GROUP_WIDTH slots at once
+and compares values only where the 7 bit fragment matches, so most probes
+never touch the slots. Values are stored densely in their own array. */
+template<class T, class Hash = std::hash<T>, class Allocator = std::allocator<T>>
+class FlatHashTable {
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+    using SlotAllocTrait = std::allocator_traits<SlotAllocator>;
+    using CtrlAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<int8_t>;
+    using CtrlAllocTrait = std::allocator_traits<CtrlAllocator>;
+
+    static const int8_t EMPTY = -128;
+    static const int8_t DELETED = -2;
+
+    static const uint32_t GROUP_WIDTH = 16;
+    /* Maximum load, counting deleted slots, is 7/8. */
+    static const uint32_t MAX_LOAD_NUM = 7;
+    static const uint32_t MAX_LOAD_DEN = 8;
+
+    /* Bit i of a mask stands for slot i of the group. */
+    class Group {
+#if defined(__SSE2__)
+        __m128i ctrl;
+    public:
+        explicit Group(const int8_t* p_ctrl) : ctrl(_mm_loadu_si128((const __m128i*)p_ctrl)) {}
+
+        uint32_t Match(int8_t h2) const {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+        }
+
+        uint32_t MatchEmpty() const {
+            return Match(EMPTY);
+        }
+
+        /* EMPTY and DELETED are the only control words with the sign bit set. */
+        uint32_t MatchEmptyOrDeleted() const {
+            return _mm_movemask_epi8(ctrl);
+        }
+#else
+        const int8_t* p_ctrl;
+    public:
+        explicit Group(const int8_t* i_p_ctrl) : p_ctrl(i_p_ctrl) {}
+
+        uint32_t Match(int8_t h2) const {
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+                mask |= (uint32_t)(p_ctrl[i] == h2) << i;
+            }
+            return mask;
+        }
+
+        uint32_t MatchEmpty() const {
+            return Match(EMPTY);
+        }
+
+        uint32_t MatchEmptyOrDeleted() const {
+            uint32_t mask = 0;
+            for (uint32_t i = 0; i < GROUP_WIDTH; i++) {
+                mask |= (uint32_t)(p_ctrl[i] < 0) << i;
+            }
+            return mask;
+        }
+#endif
+
+        uint32_t MatchFull() const {
+            return ~MatchEmptyOrDeleted() & ((1u << GROUP_WIDTH) - 1);
+        }
+    };
+
+    static uint32_t lowest_bit(uint32_t mask) {
+        return __builtin_ctz(mask);
+    }
+
+    static uint32_t highest_bit(uint32_t mask) {
+        return 31 - __builtin_clz(mask);
+    }
+
+    SlotAllocator slot_alloc;
+    CtrlAllocator ctrl_alloc;
+    T*            p_slots;
+    int8_t*       p_ctrl;
+
+    uint32_t capacity;
+    uint32_t size;
+    uint32_t deleted;
+
+    /* std::hash of an integer is the integer itself, so the bits are mixed
+    before they are split into the group index and the control fragment. */
+    static uint64_t mix(size_t hash) {
+        uint64_t h = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+
+    static uint32_t h1(uint64_t hash) {
+        return (uint32_t)(hash >> 7);
+    }
+
+    static int8_t h2(uint64_t hash) {
+        return (int8_t)(hash & 0x7F);
+    }
+
+    /* Groups are probed in triangular order, which visits every group when
+    their number is a power of two. */
+    uint32_t first_group(uint64_t hash) const {
+        return h1(hash) & (capacity / GROUP_WIDTH - 1);
+    }
+
+    uint32_t next_group(uint32_t group, uint32_t num_probe) const {
+        return (group + num_probe) & (capacity / GROUP_WIDTH - 1);
+    }
+
+    void set_ctrl(uint32_t idx, int8_t ctrl) {
+        p_ctrl[idx] = ctrl;
+    }
+
+    /* Index of the slot holding value, or capacity. */
+    uint32_t find(const T& value, uint64_t hash) const {
+        if (capacity == 0)
+            return capacity;
+
+        uint32_t group = first_group(hash);
+        for (uint32_t num_probe = 1; ; num_probe++) {
+            Group g(p_ctrl + group * GROUP_WIDTH);
+            for (uint32_t mask = g.Match(h2(hash)); mask != 0; mask &= mask - 1) {
+                uint32_t idx = group * GROUP_WIDTH + lowest_bit(mask);
+                if (p_slots[idx] == value)
+                    return idx;
+            }
+
+            /* A group with an empty slot ends every probe sequence through it. */
+            if (g.MatchEmpty() != 0 || num_probe == capacity / GROUP_WIDTH)
+                return capacity;
+
+            group = next_group(group, num_probe);
+        }
+    }
+
+    /* First empty or deleted slot on the probe sequence of hash. The table is
+    never full, so there always is one. */
+    uint32_t find_free(uint64_t hash) const {
+        uint32_t group = first_group(hash);
+        for (uint32_t num_probe = 1; ; num_probe++) {
+            uint32_t mask = Group(p_ctrl + group * GROUP_WIDTH).MatchEmptyOrDeleted();
+            if (mask != 0)
+                return group * GROUP_WIDTH + lowest_bit(mask);
+
+            group = next_group(group, num_probe);
+        }
+    }
+
+    /* Move every value into fresh arrays of new_cap slots, which also drops
+    the deleted slots. */
+    void rehash(uint32_t new_cap) {
+        T*       p_old_slots = p_slots;
+        int8_t*  p_old_ctrl = p_ctrl;
+        uint32_t old_cap = capacity;
+
+        p_slots = SlotAllocTrait::allocate(slot_alloc, new_cap);
+        try {
+            p_ctrl = CtrlAllocTrait::allocate(ctrl_alloc, new_cap);
+        }
+        catch (...) {
+            SlotAllocTrait::deallocate(slot_alloc, p_slots, new_cap);
+            p_slots = p_old_slots;
+            throw;
+        }
+        memset(p_ctrl, EMPTY, new_cap);
+        capacity = new_cap;
+        deleted = 0;
+
+        for (uint32_t idx = 0; idx < old_cap; idx++) {
+            if (p_old_ctrl[idx] < 0)
+                continue;
+
+            uint64_t hash = mix(Hash{}(p_old_slots[idx]));
+            uint32_t new_idx = find_free(hash);
+            SlotAllocTrait::construct(slot_alloc, p_slots + new_idx, std::move(p_old_slots[idx]));
+            SlotAllocTrait::destroy(slot_alloc, p_old_slots + idx);
+            set_ctrl(new_idx, h2(hash));
+        }
+
+        if (old_cap != 0) {
+            SlotAllocTrait::deallocate(slot_alloc, p_old_slots, old_cap);
+            CtrlAllocTrait::deallocate(ctrl_alloc, p_old_ctrl, old_cap);
+        }
+    }
+
+    /* Make room for one more value. When most of the used slots are only
+    deleted ones, the table is cleaned up at the same capacity instead of
+    growing. */
+    void reserve_one() {
+        if (capacity == 0) {
+            rehash(GROUP_WIDTH);
+        }
+        else if ((uint64_t)(size + deleted + 1) * MAX_LOAD_DEN > (uint64_t)capacity * MAX_LOAD_NUM) {
+            if ((uint64_t)(size + 1) * MAX_LOAD_DEN * 2 <= (uint64_t)capacity * MAX_LOAD_NUM) {
+                rehash(capacity);
+            }
+            else {
+                rehash(capacity * 2);
+            }
+        }
+    }
+
+    uint32_t next_full(uint32_t idx) const {
+        while (idx < capacity) {
+            uint32_t mask = Group(p_ctrl + (idx & ~(GROUP_WIDTH - 1))).MatchFull() >> (idx & (GROUP_WIDTH - 1));
+            if (mask != 0)
+                return idx + lowest_bit(mask);
+
+            idx = (idx & ~(GROUP_WIDTH - 1)) + GROUP_WIDTH;
+        }
+
+        return capacity;
+    }
+
+    /* Last full slot before idx, or idx itself if there is none. */
+    uint32_t prev_full(uint32_t idx) const {
+        uint32_t cur = idx;
+        while (cur != 0) {
+            uint32_t base = (cur - 1) & ~(GROUP_WIDTH - 1);
+            uint32_t mask = Group(p_ctrl + base).MatchFull() & ((2u << ((cur - 1) - base)) - 1);
+            if (mask != 0)
+                return base + highest_bit(mask);
+
+            cur = base;
+        }
+
+        return idx;
+    }
+
+    public:
+
+    class iterator: public std::iterator< std::bidirectional_iterator_tag, T> {
+        const FlatHashTable* p_table;
+        uint32_t             idx;
+    public:
+        explicit iterator(const FlatHashTable* i_p_table, uint32_t i_idx) : p_table(i_p_table),
+                                                                            idx(i_idx) {}
+        iterator& operator++() {
+            assert(idx != p_table->capacity);
+
+            idx = p_table->next_full(idx + 1);
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator res = *this;
+            ++(*this);
+            return res;
+        }
+
+        iterator& operator--() {
+            assert(idx != 0);
+
+            idx = p_table->prev_full(idx);
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator res = *this;
+            --(*this);
+            return res;
+        }
+
+        bool operator==(iterator other) const{
+            return idx == other.idx;
+        }
+
+        bool operator!=(iterator other) const{
+            return !((*this) == other);
+        }
+
+        const T& operator*() const{
+            return p_table->p_slots[idx];
+        }
+
+        friend class FlatHashTable<T, Hash, Allocator>;
+    };
+
+    FlatHashTable() : FlatHashTable(Allocator()) {}
+
+    explicit FlatHashTable(const Allocator& allocator) : slot_alloc(allocator),
+                                                         ctrl_alloc(allocator),
+                                                         p_slots(nullptr),
+                                                         p_ctrl(nullptr),
+                                                         capacity(0),
+                                                         size(0),
+                                                         deleted(0) {}
+
+    FlatHashTable(const FlatHashTable&) = delete;
+    FlatHashTable& operator = (const FlatHashTable&) = delete;
+
+    ~FlatHashTable() {
+        Clear();
+        if (capacity != 0) {
+            SlotAllocTrait::deallocate(slot_alloc, p_slots, capacity);
+            CtrlAllocTrait::deallocate(ctrl_alloc, p_ctrl, capacity);
+        }
+    }
+
+    /* Destroy every value, the capacity is kept. */
+    void Clear(){
+        for (uint32_t idx = next_full(0); idx < capacity; idx = next_full(idx + 1)) {
+            SlotAllocTrait::destroy(slot_alloc, p_slots + idx);
+        }
+
+        if (capacity != 0) {
+            memset(p_ctrl, EMPTY, capacity);
+        }
+        size = 0;
+        deleted = 0;
+    }
+
+    iterator begin() const{
+        return iterator(this, next_full(0));
+    }
+
+    iterator end() const{
+        return iterator(this, capacity);
+    }
+
+    iterator Insert(T&& value) {
+        uint64_t hash = mix(Hash{}(value));
+        if (find(value, hash) != capacity)
+            return end();
+
+        reserve_one();
+
+        uint32_t idx = find_free(hash);
+        SlotAllocTrait::construct(slot_alloc, p_slots + idx, std::forward<T>(value));
+        if (p_ctrl[idx] == DELETED) {
+            deleted--;
+        }
+        set_ctrl(idx, h2(hash));
+
+        size++;
+        return iterator(this, idx);
+    }
+
+    bool Erase(iterator it) {
+        if (it == end())
+            return false;
+
+        uint32_t idx = it.idx;
+        SlotAllocTrait::destroy(slot_alloc, p_slots + idx);
+
+        /* Probes only go on past a group without empty slots, so if there is
+        one in this group the slot can simply become empty again. */
+        if (Group(p_ctrl + (idx & ~(GROUP_WIDTH - 1))).MatchEmpty() != 0) {
+            set_ctrl(idx, EMPTY);
+        }
+        else {
+            set_ctrl(idx, DELETED);
+            deleted++;
+        }
+
+        size--;
+        return true;
+    }
+
+    iterator Search(const T& value) const{
+        return iterator(this, find(value, mix(Hash{}(value))));
+    }
+
+    uint32_t Capacity() const{
+        return capacity;
+    }
+
+    uint32_t Size() const{
+        return size;
+    }
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+/* Hash usable in constant expressions, for FrozenHashTable. std::hash is not
+constexpr. Strings are hashed with FNV-1a, integers and enums as their value;
+both are passed through a finalizer. */
+struct FrozenHash {
+    static constexpr uint64_t mix(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    constexpr uint64_t operator()(std::string_view value) const {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : value) {
+            hash = (hash ^ (uint8_t)c) * 0x100000001B3ull;
+        }
+        return mix(hash);
+    }
+
+    template<class I, class = std::enable_if_t<std::is_integral_v<I> || std::is_enum_v<I>>>
+    constexpr uint64_t operator()(I value) const {
+        return mix((uint64_t)value);
+    }
+};
+
+/* Read only hash set over N keys known at compile time. The layout is found
+by hash and displace when the table is built, which may happen in a constant
+expression: keys are first split into buckets, then every bucket, largest
+first, gets the smallest displacement that puts all its keys into free
+slots. A lookup hashes the key once, reads the displacement of its bucket and
+compares against the single key its slot can hold.
+
+Keys are kept in the order given, which is also the order of iteration. They
+must be distinct; building from duplicates throws, which in a constant
+expression is a compile error. */
+template<class T, size_t N, class Hash = FrozenHash>
+class FrozenHashTable {
+    static_assert(N != 0, "A frozen table needs at least one key");
+
+    static const uint32_t EMPTY = UINT32_MAX;
+    /* Bounds the search for a bucket displacement. The loads below make even
+    the first buckets succeed within a few tries. */
+    static const uint32_t MAX_DISPLACEMENT = 1 << 16;
+
+    static constexpr size_t pow2_at_least(size_t n) {
+        size_t pow2 = 1;
+        while (pow2 < n) {
+            pow2 *= 2;
+        }
+        return pow2;
+    }
+
+    /* At most 80% of the slots are used, and buckets hold two keys on average. */
+    static constexpr size_t CAPACITY = pow2_at_least((N * 5 + 3) / 4);
+    static constexpr size_t BUCKET_COUNT = pow2_at_least((N + 1) / 2);
+
+    std::array<T, N>                   values;
+    std::array<uint32_t, BUCKET_COUNT> displacements;
+    std::array<uint32_t, CAPACITY>     slots;
+
+    static constexpr uint32_t bucket_of(uint64_t hash) {
+        return (uint32_t)(hash >> 32) & (BUCKET_COUNT - 1);
+    }
+
+    static constexpr uint32_t slot_of(uint64_t hash, uint32_t displacement) {
+        return (uint32_t)FrozenHash::mix(hash + displacement * 0x9E3779B97F4A7C15ull) & (CAPACITY - 1);
+    }
+
+    /* Try to place the keys of bucket at displacement, leaving slots as they
+    were if any of them collides. */
+    constexpr bool place_bucket(const std::array<uint64_t, N>& hashes, uint32_t bucket, uint32_t displacement) {
+        for (uint32_t i = 0; i < N; i++) {
+            if (bucket_of(hashes[i]) != bucket)
+                continue;
+
+            uint32_t slot = slot_of(hashes[i], displacement);
+            if (slots[slot] != EMPTY) {
+                for (uint32_t j = 0; j < i; j++) {
+                    if (bucket_of(hashes[j]) == bucket && slots[slot_of(hashes[j], displacement)] == j) {
+                        slots[slot_of(hashes[j], displacement)] = EMPTY;
+                    }
+                }
+                return false;
+            }
+            slots[slot] = i;
+        }
+        return true;
+    }
+
+public:
+    using iterator = const T*;
+
+    constexpr explicit FrozenHashTable(const T (&keys)[N]) : values(), displacements(), slots() {
+        std::array<uint64_t, N> hashes{};
+        std::array<uint32_t, BUCKET_COUNT> bucket_sizes{};
+        for (uint32_t i = 0; i < N; i++) {
+            for (uint32_t j = 0; j < i; j++) {
+                if (keys[j] == keys[i])
+                    throw std::invalid_argument("FrozenHashTable keys must be distinct");
+            }
+
+            values[i] = keys[i];
+            hashes[i] = Hash{}(keys[i]);
+            bucket_sizes[bucket_of(hashes[i])]++;
+        }
+
+        for (uint32_t slot = 0; slot < CAPACITY; slot++) {
+            slots[slot] = EMPTY;
+        }
+
+        /* Large buckets are the hardest to place, so they go first while most
+        slots are free. */
+        for (uint32_t bucket_size = N; bucket_size != 0; bucket_size--) {
+            for (uint32_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+                if (bucket_sizes[bucket] != bucket_size)
+                    continue;
+
+                uint32_t displacement = 0;
+                while (!place_bucket(hashes, bucket, displacement)) {
+                    if (++displacement == MAX_DISPLACEMENT)
+                        throw std::invalid_argument("FrozenHashTable found no layout for the keys");
+                }
+                displacements[bucket] = displacement;
+            }
+        }
+    }
+
+    constexpr iterator begin() const {
+        return values.data();
+    }
+
+    constexpr iterator end() const {
+        return values.data() + N;
+    }
+
+    constexpr iterator Search(const T& key) const {
+        uint64_t hash = Hash{}(key);
+        uint32_t idx = slots[slot_of(hash, displacements[bucket_of(hash)])];
+        if (idx != EMPTY && values[idx] == key)
+            return begin() + idx;
+
+        return end();
+    }
+
+    constexpr bool Contains(const T& key) const {
+        return Search(key) != end();
+    }
+
+    constexpr uint32_t Capacity() const {
+        return CAPACITY;
+    }
+
+    constexpr uint32_t Size() const {
+        return N;
+    }
+};
+
+/* Builds a FrozenHashTable with N taken from the initializer, e.g.
+constexpr auto commands = MakeFrozenHashTable<std::string_view>({"get", "set"}); */
+template<class T, class Hash = FrozenHash, size_t N>
+constexpr FrozenHashTable<T, N, Hash> MakeFrozenHashTable(const T (&keys)[N]) {
+    return FrozenHashTable<T, N, Hash>(keys);
+}
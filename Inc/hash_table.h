@@ -1,79 +1,498 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
 #include <variant>
 #include <memory>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 enum class CellState{NIL, DELETED};
 
-template<class T, class Hash = std::hash<T>, class Allocator = std::allocator<T>>
-class HashTable {
-    using Cell = std::variant<T, CellState>;
+/* Snapshot returned by HashTable::GetStats. The resize figures are only kept
+by tables built with COLLECT_STATS and read 0 otherwise; the rest is gathered
+by walking the table when the snapshot is taken. */
+struct HashTableStats {
+    static const uint32_t PROBE_BINS = 16;
+
+    /* probe_lengths[i] counts the values a lookup finds after i + 1 cells;
+    the last bin also takes every longer probe sequence. */
+    uint64_t probe_lengths[PROBE_BINS] = {};
+    uint32_t max_probe_length = 0;
+
+    uint32_t size = 0;
+    uint32_t capacity = 0;
+    /* Cells of erased values that still lengthen probe sequences. */
+    uint32_t tombstones = 0;
+
+    uint64_t resize_count = 0;
+    uint64_t resize_nanoseconds = 0;
+
+    double LoadFactor() const {
+        return capacity == 0 ? 0.0 : (double)(size + tombstones) / capacity;
+    }
+
+    double MeanProbeLength() const {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < PROBE_BINS; i++) {
+            total += probe_lengths[i] * (i + 1);
+        }
+        return size == 0 ? 0.0 : (double)total / size;
+    }
+
+    std::string ToJson() const {
+        std::string json = "{\"size\":" + std::to_string(size) +
+            ",\"capacity\":" + std::to_string(capacity) +
+            ",\"tombstones\":" + std::to_string(tombstones) +
+            ",\"load_factor\":" + std::to_string(LoadFactor()) +
+            ",\"max_probe_length\":" + std::to_string(max_probe_length) +
+            ",\"mean_probe_length\":" + std::to_string(MeanProbeLength()) +
+            ",\"resize_count\":" + std::to_string(resize_count) +
+            ",\"resize_nanoseconds\":" + std::to_string(resize_nanoseconds) +
+            ",\"probe_lengths\":[";
+
+        for (uint32_t i = 0; i < PROBE_BINS; i++) {
+            json += (i == 0 ? "" : ",") + std::to_string(probe_lengths[i]);
+        }
+        return json + "]}";
+    }
+};
+
+/* Open addressing engine shared by HashTable and HashMap. Cells hold values of
+type Value, looked up by the Key that KeyOf extracts from them. The template
+flags are described at HashTable. */
+template<class Value, class Key, class KeyOf, class Hash, class KeyEqual, class Allocator,
+    bool POW2_CAPACITY, bool STORE_HASH, bool INCREMENTAL_RESIZE, bool COLLECT_STATS>
+class HashTableCore {
+    struct HashedValue {
+        Value    value;
+        uint64_t hash;
+
+        template<class... Args>
+        explicit HashedValue(uint64_t i_hash, Args&&... args) : value(std::forward<Args>(args)...),
+                                                                 hash(i_hash) {}
+    };
+
+    using Entry = std::conditional_t<STORE_HASH, HashedValue, Value>;
+    using Cell = std::variant<Entry, CellState>;
     using CellAllocator = typename std::allocator_traits <Allocator> ::template rebind_alloc <Cell>;
     using CellAllocTrait = std::allocator_traits<CellAllocator>;
+    using WordAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<uint64_t>;
+    using WordAllocTrait = std::allocator_traits<WordAllocator>;
 
     static const int INIT_SIZE = 1;
     static const int OCCUPANCY_PERCENT = 80;
+    /* Growing doubles the capacity at 80% occupancy, so the next resize is at
+    least 0.8 * old capacity inserts away. Moving 8 cells per operation
+    leaves the old cells empty long before that. */
+    static const uint32_t MIGRATE_CELLS = 8;
+
+    /* The capacity only ever doubles from INIT_SIZE. */
+    static_assert(!POW2_CAPACITY || (INIT_SIZE & (INIT_SIZE - 1)) == 0, "Initial size must be a power of two");
 
     CellAllocator alloc;
+    WordAllocator word_alloc;
     Cell*         begin_addr;
     Cell*         end_addr;
+    /* Bit i is set while cell i holds a value, so that iteration skips runs
+    of NIL and deleted cells a word at a time. */
+    uint64_t*     p_occupied;
+
+    /* Cells of the previous capacity still being moved in incremental mode,
+    nullptr otherwise. The cells before p_migrate have been moved and hold
+    CellState::DELETED, so probe sequences through them go on. */
+    Cell*         old_begin_addr;
+    Cell*         old_end_addr;
+    uint64_t*     p_old_occupied;
+    Cell*         p_migrate;
 
     uint32_t  size;
+    /* Cells holding CellState::DELETED. They count against the occupancy
+    like values do, since they lengthen probe sequences just the same. */
+    uint32_t  deleted;
+
+    struct ResizeCounters {
+        uint64_t count = 0;
+        uint64_t nanoseconds = 0;
+    };
+    struct NoResizeCounters {};
 
-    uint32_t h(uint32_t hash, uint32_t num_probe, uint32_t cap) const{
-        return (hash % cap + num_probe * (hash % 2 == 0 ? hash + 1 : hash)) % cap;
+    std::conditional_t<COLLECT_STATS, ResizeCounters, NoResizeCounters> resizes;
+
+    static uint64_t mix(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    /* Computed once per operation and passed to h() for every probe. */
+    template<class K>
+    static uint64_t hash_of(const K& key) {
+        if constexpr (POW2_CAPACITY) {
+            return mix(Hash{}(key));
+        }
+        else {
+            return (uint32_t)Hash{}(key);
+        }
+    }
+
+    static bool is_nil(const Cell& cell) {
+        return std::holds_alternative<CellState>(cell) && std::get<CellState>(cell) == CellState::NIL;
+    }
+
+    static Value& value_of(Cell& cell) {
+        if constexpr (STORE_HASH) {
+            return std::get<Entry>(cell).value;
+        }
+        else {
+            return std::get<Entry>(cell);
+        }
+    }
+
+    static const Value& value_of(const Cell& cell) {
+        return value_of(const_cast<Cell&>(cell));
+    }
+
+    static uint64_t hash_of_cell(const Cell& cell) {
+        if constexpr (STORE_HASH) {
+            return std::get<Entry>(cell).hash;
+        }
+        else {
+            return hash_of(KeyOf{}(value_of(cell)));
+        }
+    }
+
+    template<class K>
+    static bool cell_matches(const Cell& cell, const K& key, uint64_t hash) {
+        if constexpr (STORE_HASH) {
+            if (std::get<Entry>(cell).hash != hash)
+                return false;
+        }
+        return KeyEqual{}(KeyOf{}(value_of(cell)), key);
+    }
+
+    /* The value is built in the cell from args, without a temporary. */
+    template<class... Args>
+    void construct_entry(Cell* p_cell, uint64_t hash, Args&&... args) {
+        if constexpr (STORE_HASH) {
+            CellAllocTrait::construct(alloc, p_cell, std::in_place_type<Entry>, hash, std::forward<Args>(args)...);
+        }
+        else {
+            CellAllocTrait::construct(alloc, p_cell, std::in_place_type<Entry>, std::forward<Args>(args)...);
+        }
+    }
+
+    /* Smallest capacity that holds num_values values without growing. It is
+    a power of two in both modes, so that the probe step is always coprime
+    with it. */
+    static uint32_t capacity_for(uint32_t num_values) {
+        uint64_t min_cap = ((uint64_t)num_values * 100 + OCCUPANCY_PERCENT - 1) / OCCUPANCY_PERCENT;
+        uint32_t cap = INIT_SIZE;
+        while (cap < min_cap) {
+            cap *= 2;
+        }
+        return cap;
+    }
+
+    uint32_t h(uint64_t hash, uint32_t num_probe, uint32_t cap) const{
+        if constexpr (POW2_CAPACITY) {
+            /* An odd step is coprime with the capacity, so every cell is
+            visited. */
+            uint32_t step = (uint32_t)(hash >> 32) | 1;
+            return ((uint32_t)hash + num_probe * step) & (cap - 1);
+        }
+        else {
+            uint32_t hash32 = (uint32_t)hash;
+            return (hash32 % cap + num_probe * (hash32 % 2 == 0 ? hash32 + 1 : hash32)) % cap;
+        }
+    }
+
+    static Cell* alloc_cells(CellAllocator& alloc, uint32_t cap) {
+        Cell* p_cells = CellAllocTrait::allocate(alloc, cap);
+        for (Cell* p_i = p_cells; p_i < p_cells + cap; p_i++) {
+            CellAllocTrait::construct(alloc, p_i, CellState::NIL);
+        }
+        return p_cells;
+    }
+
+    void free_cells(Cell* p_cells, Cell* p_cells_end) {
+        for (Cell* p_i = p_cells; p_i < p_cells_end; p_i++) {
+            CellAllocTrait::destroy(alloc, p_i);
+        }
+        CellAllocTrait::deallocate(alloc, p_cells, p_cells_end - p_cells);
+    }
+
+    static uint32_t words_for(uint32_t cap) {
+        return (cap + 63) / 64;
+    }
+
+    uint64_t* alloc_bitmap(uint32_t cap) {
+        uint64_t* p_words = WordAllocTrait::allocate(word_alloc, words_for(cap));
+        std::fill(p_words, p_words + words_for(cap), 0);
+        return p_words;
+    }
+
+    void free_bitmap(uint64_t* p_words, uint32_t cap) {
+        WordAllocTrait::deallocate(word_alloc, p_words, words_for(cap));
+    }
+
+    /* p_cell is in the current or in the old cells. */
+    void set_occupied(Cell* p_cell, bool occupied) {
+        uint64_t* p_words = p_occupied;
+        uint32_t idx = p_cell - begin_addr;
+        if (!(p_cell >= begin_addr && p_cell < end_addr)) {
+            p_words = p_old_occupied;
+            idx = p_cell - old_begin_addr;
+        }
+
+        if (occupied) {
+            p_words[idx / 64] |= 1ull << (idx % 64);
+        }
+        else {
+            p_words[idx / 64] &= ~(1ull << (idx % 64));
+        }
+    }
+
+    /* First set bit at or after idx, or cap. */
+    static uint32_t scan_forward(const uint64_t* p_words, uint32_t idx, uint32_t cap) {
+        while (idx < cap) {
+            uint64_t word = p_words[idx / 64] >> (idx % 64);
+            if (word != 0)
+                return idx + __builtin_ctzll(word);
+
+            idx = (idx / 64 + 1) * 64;
+        }
+        return cap;
+    }
+
+    /* Last set bit before idx, or idx itself if there is none. */
+    static uint32_t scan_backward(const uint64_t* p_words, uint32_t idx) {
+        uint32_t cur = idx;
+        while (cur != 0) {
+            uint32_t base = (cur - 1) / 64 * 64;
+            uint32_t num_bits = cur - base;
+            uint64_t word = p_words[base / 64];
+            if (num_bits < 64) {
+                word &= (1ull << num_bits) - 1;
+            }
+            if (word != 0)
+                return base + 63 - __builtin_clzll(word);
+
+            cur = base;
+        }
+        return idx;
+    }
+
+    /* Move a value from an old cell into the current cells. */
+    void move_cell(Cell* p_from) {
+        Cell* p_to = find_free(hash_of_cell(*p_from));
+        CellAllocTrait::destroy(alloc, p_to);
+        CellAllocTrait::construct(alloc, p_to, std::move(*p_from));
+        set_occupied(p_to, true);
+    }
+
+    void migrate(uint32_t num_cells) {
+        if (old_begin_addr == nullptr)
+            return;
+
+        for (; num_cells != 0 && p_migrate != old_end_addr; num_cells--, p_migrate++) {
+            if (std::holds_alternative<CellState>(*p_migrate))
+                continue;
+
+            move_cell(p_migrate);
+            CellAllocTrait::destroy(alloc, p_migrate);
+            CellAllocTrait::construct(alloc, p_migrate, CellState::DELETED);
+            set_occupied(p_migrate, false);
+        }
+
+        /* Every old cell now holds a CellState, which needs no destruction, so
+        the cells are released without another pass over them. */
+        if (p_migrate == old_end_addr) {
+            free_bitmap(p_old_occupied, old_end_addr - old_begin_addr);
+            CellAllocTrait::deallocate(alloc, old_begin_addr, old_end_addr - old_begin_addr);
+            old_begin_addr = nullptr;
+            old_end_addr = nullptr;
+            p_old_occupied = nullptr;
+            p_migrate = nullptr;
+        }
+    }
+
+    void finish_migration() {
+        if (old_begin_addr != nullptr) {
+            migrate(old_end_addr - p_migrate);
+        }
     }
 
     void extend_capacity(uint32_t new_cap) {
         if (new_cap < Capacity())
             return;
 
-        Cell* new_begin_addr = CellAllocTrait::allocate(alloc, new_cap);
-        Cell* new_end_addr = new_begin_addr + new_cap;
+        if constexpr (COLLECT_STATS) {
+            auto start = std::chrono::steady_clock::now();
+            rebuild(new_cap);
+            resizes.count++;
+            resizes.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+        else {
+            rebuild(new_cap);
+        }
+    }
+
+    /* In INCREMENTAL_RESIZE mode this only sets up the new cells, the values
+    move over later. */
+    void rebuild(uint32_t new_cap) {
+        finish_migration();
 
-        for (Cell* p_i = new_begin_addr; p_i < new_end_addr; p_i++) {
-            CellAllocTrait::construct(alloc, p_i, CellState::NIL);
+        uint64_t* p_new_occupied = alloc_bitmap(new_cap);
+        Cell* p_new_cells;
+        try {
+            p_new_cells = alloc_cells(alloc, new_cap);
+        }
+        catch (...) {
+            free_bitmap(p_new_occupied, new_cap);
+            throw;
         }
-        
-        for (Cell* p_i = begin_addr, *new_p_i = new_begin_addr; p_i < end_addr; p_i++, new_p_i++) {
-            if(std::holds_alternative<CellState>(*p_i))
-                continue;
 
-            for (uint32_t num_probe = 0; num_probe < new_cap; num_probe++) {
-                uint32_t cur_idx = h(Hash{}(std::get<T>(*p_i)), num_probe, new_cap);
-                if (std::holds_alternative<CellState>(new_begin_addr[cur_idx])) {
-                    CellAllocTrait::destroy(alloc, new_begin_addr + cur_idx);
-                    CellAllocTrait::construct(alloc, new_begin_addr + cur_idx, std::forward<Cell>(*p_i));
-                    CellAllocTrait::destroy(alloc, p_i);
-                    break;
-                }
-            }
+        old_begin_addr = begin_addr;
+        old_end_addr = end_addr;
+        p_old_occupied = p_occupied;
+        p_migrate = begin_addr;
+
+        begin_addr = p_new_cells;
+        end_addr = begin_addr + new_cap;
+        p_occupied = p_new_occupied;
+        deleted = 0;
+
+        if (!INCREMENTAL_RESIZE) {
+            finish_migration();
+        }
+    }
+
+    /* Make room for one more value, returns true if the table was rebuilt.
+    Deleted cells are only dropped when the table is rebuilt. If the values
+    alone take at most 3/4 of the allowed occupancy, the table is rebuilt at
+    the same capacity rather than grown, so that churn does not grow it. */
+    bool reserve_one() {
+        if(Capacity() == 0){
+            extend_capacity(INIT_SIZE);
+            return true;
+        }
+
+        if (((size + deleted) * 100.0) / Capacity() <= OCCUPANCY_PERCENT)
+            return false;
+
+        if ((size * 100.0) / Capacity() <= OCCUPANCY_PERCENT * 3 / 4) {
+            extend_capacity(Capacity());
+        }
+        else {
+            extend_capacity(Capacity() * 2);
+        }
+        return true;
+    }
+
+    /* First NIL or deleted cell on the probe sequence of hash. */
+    Cell* find_free(uint64_t hash) const {
+        for (uint32_t num_probe = 0; num_probe < Capacity(); num_probe++) {
+            uint32_t cur_idx = h(hash, num_probe, Capacity());
+            if (std::holds_alternative<CellState>(begin_addr[cur_idx]))
+                return begin_addr + cur_idx;
+        }
+
+        return nullptr;
+    }
+
+    /* Cell holding key among the cells not moved yet, or nullptr. */
+    template<class K>
+    Cell* search_old(const K& key, uint64_t hash) const {
+        uint32_t old_cap = old_end_addr - old_begin_addr;
+        for (uint32_t num_probe = 0; num_probe < old_cap; num_probe++) {
+            Cell* p_cell = old_begin_addr + h(hash, num_probe, old_cap);
+            if (is_nil(*p_cell))
+                return nullptr;
+
+            if (std::holds_alternative<Entry>(*p_cell) && cell_matches(*p_cell, key, hash))
+                return p_cell;
         }
 
-        CellAllocTrait::deallocate(alloc, begin_addr, end_addr - begin_addr);
-        begin_addr = new_begin_addr;
-        end_addr = new_end_addr;
+        return nullptr;
+    }
+
+    /* Number of cells a lookup of the value in p_cell visits, p_cell included. */
+    uint32_t probe_length(const Cell* p_cell, const Cell* p_cells, uint32_t cap) const {
+        uint64_t hash = hash_of_cell(*p_cell);
+        uint32_t num_probe = 0;
+        while (p_cells + h(hash, num_probe, cap) != p_cell) {
+            num_probe++;
+        }
+        return num_probe + 1;
+    }
+
+    /* Iteration visits the old cells, if any, then the current ones. The
+    position just past the old cells stands for the first current cell, and
+    end_addr is taken as the end of the current cells even if the old cells
+    happen to follow them in memory. */
+    bool in_current_cells(Cell* p_cell) const {
+        return p_cell >= begin_addr && p_cell <= end_addr;
+    }
+
+    /* First cell holding a value at or after p_cell, or end_addr. */
+    Cell* seek_forward(Cell* p_cell) const {
+        if (!in_current_cells(p_cell)) {
+            uint32_t old_cap = old_end_addr - old_begin_addr;
+            uint32_t idx = scan_forward(p_old_occupied, p_cell - old_begin_addr, old_cap);
+            if (idx != old_cap)
+                return old_begin_addr + idx;
+
+            p_cell = begin_addr;
+        }
+
+        return begin_addr + scan_forward(p_occupied, p_cell - begin_addr, Capacity());
+    }
+
+    /* Last cell holding a value before p_cell, or nullptr. */
+    Cell* seek_backward(Cell* p_cell) const {
+        if (in_current_cells(p_cell)) {
+            uint32_t idx = p_cell - begin_addr;
+            uint32_t prev_idx = scan_backward(p_occupied, idx);
+            if (prev_idx != idx)
+                return begin_addr + prev_idx;
+            if (old_begin_addr == nullptr)
+                return nullptr;
+
+            p_cell = old_end_addr;
+        }
+
+        uint32_t idx = p_cell - old_begin_addr;
+        uint32_t prev_idx = scan_backward(p_old_occupied, idx);
+        return prev_idx != idx ? old_begin_addr + prev_idx : nullptr;
     }
 
     public:
 
-    class iterator: public std::iterator< std::bidirectional_iterator_tag, T> {
-        Cell*    p_idx;
-        Cell*    begin_addr;
-        Cell*    end_addr;
+    /* Keys are never handed out for modification: a set hands out its values
+    as const, a map only its mapped part. */
+    using reference = std::conditional_t<std::is_same_v<Value, Key>, const Value&, Value&>;
+    using pointer = std::conditional_t<std::is_same_v<Value, Key>, const Value*, Value*>;
+
+    class iterator: public std::iterator< std::bidirectional_iterator_tag, Value> {
+        Cell*                p_idx;
+        const HashTableCore* p_table;
     public:
-        explicit iterator(Cell* i_idx, Cell* i_begin_addr, Cell* i_end_addr) : p_idx(i_idx),
-                                                                                begin_addr(i_begin_addr),
-                                                                                end_addr(i_end_addr) {}
+        explicit iterator(Cell* i_idx, const HashTableCore* i_p_table) : p_idx(i_idx),
+                                                                         p_table(i_p_table) {}
         iterator& operator++() {
-            assert(p_idx != end_addr);
-
-            do {
-                p_idx++;
-            } while (std::holds_alternative<CellState>(*p_idx) && p_idx != end_addr);
+            assert(p_idx != p_table->end_addr);
 
+            p_idx = p_table->seek_forward(p_idx + 1);
             return *this;
         }
 
@@ -84,16 +503,11 @@ class HashTable {
         }
 
         iterator& operator--() {
-            assert(p_idx != begin_addr);
-
-            Cell* tmp = p_idx;
+            Cell* p_prev = p_table->seek_backward(p_idx);
+            assert(p_prev != nullptr);
 
-            do {
-                tmp--;
-            } while (std::holds_alternative<CellState>(*tmp) && tmp != begin_addr);
-
-            if (std::holds_alternative<T>(*tmp)) {
-                p_idx = tmp;
+            if (p_prev != nullptr) {
+                p_idx = p_prev;
             }
 
             return *this;
@@ -113,65 +527,88 @@ class HashTable {
             return !((*this) == other);
         }
 
-        const T& operator*() const{
-            return std::get<T>(*(p_idx));
+        reference operator*() const{
+            return value_of(*(p_idx));
+        }
+
+        pointer operator->() const{
+            return &value_of(*(p_idx));
         }
 
-        friend class HashTable<T, Hash, Allocator>;
+        friend class HashTableCore;
     };
 
-    HashTable() : size(0) {        
-        begin_addr = CellAllocTrait::allocate(alloc, INIT_SIZE);
-        end_addr = begin_addr + (INIT_SIZE);
-        CellAllocTrait::construct(alloc, begin_addr, CellState::NIL);
+    HashTableCore() : HashTableCore(Allocator()) {}
+
+    explicit HashTableCore(const Allocator& allocator) : HashTableCore(0, allocator) {}
+
+    /* Start with room for capacity_hint values, so that a bulk load of known
+    size allocates once. */
+    explicit HashTableCore(uint32_t capacity_hint, const Allocator& allocator = Allocator()) : alloc(allocator),
+                                                                                                  word_alloc(allocator),
+                                                                                                  old_begin_addr(nullptr),
+                                                                                                  old_end_addr(nullptr),
+                                                                                                  p_old_occupied(nullptr),
+                                                                                                  p_migrate(nullptr),
+                                                                                                  size(0),
+                                                                                                  deleted(0) {
+        uint32_t cap = capacity_for(capacity_hint);
+
+        p_occupied = alloc_bitmap(cap);
+        try {
+            begin_addr = alloc_cells(alloc, cap);
+        }
+        catch (...) {
+            free_bitmap(p_occupied, cap);
+            throw;
+        }
+        end_addr = begin_addr + cap;
     }
 
-    ~HashTable() {
-        Clear();
+    HashTableCore(const HashTableCore&) = delete;
+    HashTableCore& operator = (const HashTableCore&) = delete;
+
+    ~HashTableCore() {
+        if (old_begin_addr != nullptr) {
+            free_bitmap(p_old_occupied, old_end_addr - old_begin_addr);
+            free_cells(old_begin_addr, old_end_addr);
+        }
+
+        free_bitmap(p_occupied, Capacity());
+        free_cells(begin_addr, end_addr);
     }
 
+    /* Destroy every value, the capacity is kept. */
     void Clear(){
-        for(Cell* i_p = begin_addr;i_p < end_addr;i_p++){
-            CellAllocTrait::destroy(alloc, i_p);
+        if (old_begin_addr != nullptr) {
+            free_bitmap(p_old_occupied, old_end_addr - old_begin_addr);
+            free_cells(old_begin_addr, old_end_addr);
+            old_begin_addr = nullptr;
+            old_end_addr = nullptr;
+            p_old_occupied = nullptr;
+            p_migrate = nullptr;
         }
 
-        CellAllocTrait::deallocate(alloc, begin_addr, end_addr - begin_addr);
+        for (Cell* p_i = begin_addr; p_i < end_addr; p_i++) {
+            CellAllocTrait::destroy(alloc, p_i);
+            CellAllocTrait::construct(alloc, p_i, CellState::NIL);
+        }
+        std::fill(p_occupied, p_occupied + words_for(Capacity()), 0);
+        size = 0;
+        deleted = 0;
     }
 
     iterator begin() const{
-        Cell* tmp = begin_addr;
-        while (std::holds_alternative<CellState>(*tmp) && tmp != end_addr) {
-            tmp++;
-        }
-
-        return iterator(tmp, begin_addr, end_addr);
+        return iterator(seek_forward(old_begin_addr != nullptr ? old_begin_addr : begin_addr), this);
     }
 
     iterator end() const{
-        return iterator(end_addr, begin_addr, end_addr);
+        return iterator(end_addr, this);
     }
 
-    iterator Insert(T&& value) {
-        if(Capacity() == 0){
-            extend_capacity(INIT_SIZE);
-        }else if ((size * 100.0) / Capacity() > OCCUPANCY_PERCENT) {
-            extend_capacity(Capacity() * 2);
-        }
-
-        for (uint32_t num_probe = 0; num_probe < Capacity(); num_probe++) {
-            uint32_t cur_idx = h(Hash{}(value), num_probe, Capacity());
-            if (std::holds_alternative<CellState>(begin_addr[cur_idx])) {
-                CellAllocTrait::destroy(alloc, begin_addr + cur_idx);
-                CellAllocTrait::construct(alloc, begin_addr + cur_idx, std::forward<T>(value));
-
-                size++;
-                return iterator(begin_addr + cur_idx, begin_addr, end_addr);
-            }else if(std::get<T>(begin_addr[cur_idx]) == value){
-                return end();
-            }
-        }
-
-        return end();
+    /* True while cells of the previous capacity are still being moved. */
+    bool IsMigrating() const{
+        return old_begin_addr != nullptr;
     }
 
     bool Erase(iterator it) {
@@ -180,29 +617,316 @@ class HashTable {
 
         CellAllocTrait::destroy(alloc, it.p_idx);
         CellAllocTrait::construct(alloc, it.p_idx, CellState::DELETED);
+        set_occupied(it.p_idx, false);
         size--;
+
+        /* A deleted old cell goes away with the old cells. */
+        if (it.p_idx >= begin_addr && it.p_idx < end_addr) {
+            deleted++;
+        }
+
+        migrate(MIGRATE_CELLS);
         return true;
     }
 
-    iterator Search(const T& value) const{
-        for (uint32_t num_probe = 0; num_probe < Capacity(); num_probe++) {
-            uint32_t cur_idx = h(Hash{}(value), num_probe, Capacity());
-            if(std::holds_alternative<CellState>(begin_addr[cur_idx]))
-                return end();
+    iterator Search(const Key& key) const{
+        return find(key);
+    }
 
-            if (std::get<T>(begin_addr[cur_idx]) == value) {
-                return iterator(begin_addr + cur_idx, begin_addr, end_addr);
+    /* Search for count keys at once, the result for p_keys[i] goes to
+    p_results[i]. All keys of a batch are hashed and their first cells
+    prefetched before any of them is looked at, so that the cache misses of
+    a table larger than the cache overlap instead of following each other. */
+    void SearchBatch(const Key* p_keys, uint32_t count, iterator* p_results) const{
+        uint64_t hashes[BATCH_SIZE];
+        for (uint32_t batch = 0; batch < count; batch += BATCH_SIZE) {
+            uint32_t batch_count = count - batch < BATCH_SIZE ? count - batch : BATCH_SIZE;
+            for (uint32_t i = 0; i < batch_count; i++) {
+                hashes[i] = prefetch_key(p_keys[batch + i]);
+            }
+            for (uint32_t i = 0; i < batch_count; i++) {
+                p_results[batch + i] = find_hashed(p_keys[batch + i], hashes[i]);
             }
         }
+    }
 
-        return end();
+    /* Lookup by any type that Hash and KeyEqual accept, when both declare
+    is_transparent, e.g. std::string_view against std::string keys. */
+    template<class K, class H = Hash, class E = KeyEqual,
+        class = typename H::is_transparent, class = typename E::is_transparent>
+    iterator Search(const K& key) const{
+        return find(key);
+    }
+
+    /* Grow once so that num_values values fit without further growth. */
+    void Reserve(uint32_t num_values) {
+        uint32_t cap = capacity_for(num_values);
+        if (cap > Capacity()) {
+            extend_capacity(cap);
+            finish_migration();
+        }
     }
 
     uint32_t Capacity() const{
         return end_addr - begin_addr;
     }
 
+    /* Longest probe sequence of any value present. Walks the whole table. */
+    uint32_t MaxProbeLength() const{
+        uint32_t max_length = 0;
+        for (iterator it = begin(); it != end(); ++it) {
+            uint32_t length = in_current_cells(it.p_idx) ? probe_length(it.p_idx, begin_addr, Capacity()) :
+                                                           probe_length(it.p_idx, old_begin_addr, old_end_addr - old_begin_addr);
+            if (length > max_length) {
+                max_length = length;
+            }
+        }
+        return max_length;
+    }
+
+    /* Walks the whole table, like MaxProbeLength. */
+    HashTableStats GetStats() const{
+        HashTableStats stats;
+        for (iterator it = begin(); it != end(); ++it) {
+            uint32_t length = in_current_cells(it.p_idx) ? probe_length(it.p_idx, begin_addr, Capacity()) :
+                                                           probe_length(it.p_idx, old_begin_addr, old_end_addr - old_begin_addr);
+            stats.probe_lengths[(length < HashTableStats::PROBE_BINS ? length : HashTableStats::PROBE_BINS) - 1]++;
+            if (length > stats.max_probe_length) {
+                stats.max_probe_length = length;
+            }
+        }
+
+        stats.size = size;
+        stats.capacity = Capacity();
+        stats.tombstones = deleted;
+        if constexpr (COLLECT_STATS) {
+            stats.resize_count = resizes.count;
+            stats.resize_nanoseconds = resizes.nanoseconds;
+        }
+        return stats;
+    }
+
     uint32_t Size() const{
         return size;
     }
-};
\ No newline at end of file
+protected:
+    /* Keys hashed and prefetched ahead of resolving them in the batch calls.
+    Enough to cover memory latency, few enough for the lines to stay cached. */
+    static const uint32_t BATCH_SIZE = 16;
+
+    /* Hash of key, with the first cell of its probe sequence on its way into
+    the cache. */
+    template<class K>
+    uint64_t prefetch_key(const K& key) const{
+        uint64_t hash = hash_of(key);
+        __builtin_prefetch(begin_addr + h(hash, 0, Capacity()));
+        return hash;
+    }
+
+    /* Insert a value built from args unless key is present already. The
+    second member of the result tells which happened; running out of memory
+    is reported by the allocator throwing. */
+    template<class K, class... Args>
+    std::pair<iterator, bool> emplace_key(const K& key, Args&&... args) {
+        return emplace_hashed(key, hash_of(key), std::forward<Args>(args)...);
+    }
+
+    /* emplace_key for a key whose hash is known already. */
+    template<class K, class... Args>
+    std::pair<iterator, bool> emplace_hashed(const K& key, uint64_t hash, Args&&... args) {
+        migrate(MIGRATE_CELLS);
+
+        /* The value may still be present past a deleted cell, so the probe
+        only stops at a NIL cell. The value goes to the first free cell seen. */
+        Cell* p_free = nullptr;
+        for (uint32_t num_probe = 0; num_probe < Capacity(); num_probe++) {
+            uint32_t cur_idx = h(hash, num_probe, Capacity());
+            if (std::holds_alternative<CellState>(begin_addr[cur_idx])) {
+                if (p_free == nullptr) {
+                    p_free = begin_addr + cur_idx;
+                }
+                if (is_nil(begin_addr[cur_idx]))
+                    break;
+            }else if(cell_matches(begin_addr[cur_idx], key, hash)){
+                return {iterator(begin_addr + cur_idx, this), false};
+            }
+        }
+
+        if (old_begin_addr != nullptr) {
+            Cell* p_cell = search_old(key, hash);
+            if (p_cell != nullptr)
+                return {iterator(p_cell, this), false};
+        }
+
+        if (reserve_one()) {
+            p_free = find_free(hash);
+        }
+
+        /* reserve_one keeps a free cell on every probe sequence. */
+        assert(p_free != nullptr);
+
+        if (!is_nil(*p_free)) {
+            deleted--;
+        }
+        CellAllocTrait::destroy(alloc, p_free);
+        construct_entry(p_free, hash, std::forward<Args>(args)...);
+        set_occupied(p_free, true);
+
+        size++;
+        return {iterator(p_free, this), true};
+    }
+
+    template<class K>
+    iterator find(const K& key) const{
+        return find_hashed(key, hash_of(key));
+    }
+
+    template<class K>
+    iterator find_hashed(const K& key, uint64_t hash) const{
+        for (uint32_t num_probe = 0; num_probe < Capacity(); num_probe++) {
+            uint32_t cur_idx = h(hash, num_probe, Capacity());
+            if(is_nil(begin_addr[cur_idx]))
+                break;
+
+            if (std::holds_alternative<Entry>(begin_addr[cur_idx]) && cell_matches(begin_addr[cur_idx], key, hash)) {
+                return iterator(begin_addr + cur_idx, this);
+            }
+        }
+
+        if (old_begin_addr != nullptr) {
+            Cell* p_cell = search_old(key, hash);
+            if (p_cell != nullptr)
+                return iterator(p_cell, this);
+        }
+
+        return end();
+    }
+};
+
+struct HashTableIdentity {
+    template<class T>
+    const T& operator()(const T& value) const{
+        return value;
+    }
+};
+
+/* POW2_CAPACITY keeps the capacity a power of two, so a probe position is
+reduced with a mask instead of a division. The hash is then passed through a
+finalizer first: std::hash of an integer is the integer itself, and sequential
+keys would otherwise fill runs of neighbouring cells. With POW2_CAPACITY off
+the hash is used as is and reduced modulo the capacity.
+
+STORE_HASH keeps the hash of every value in its cell. Growing the table then
+never calls Hash again, and a probe only compares values whose hashes are
+equal, which pays off for keys that are expensive to hash or compare, like
+long strings.
+
+INCREMENTAL_RESIZE spreads the cost of growing over later operations. The
+old cells are kept next to the new ones and every Insert and Erase moves at
+most MIGRATE_CELLS of them, so no single operation pays for the whole table.
+Until the old cells are gone Search looks in both.
+
+COLLECT_STATS counts the resizes and the time spent in them for GetStats. */
+template<class T, class Hash = std::hash<T>, class Allocator = std::allocator<T>,
+    bool POW2_CAPACITY = true, bool STORE_HASH = false, bool INCREMENTAL_RESIZE = false, bool COLLECT_STATS = false>
+class HashTable : public HashTableCore<T, T, HashTableIdentity, Hash, std::equal_to<T>, Allocator,
+                                       POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS> {
+    using Core = HashTableCore<T, T, HashTableIdentity, Hash, std::equal_to<T>, Allocator,
+                               POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS>;
+public:
+    using typename Core::iterator;
+    using Core::Core;
+
+    /* Returns end() if the value is present already. */
+    iterator Insert(T&& value) {
+        std::pair<iterator, bool> res = Core::emplace_key(value, std::move(value));
+        return res.second ? res.first : Core::end();
+    }
+
+    /* Insert count values, moving them out of p_values, prefetched in
+    batches like SearchBatch. Returns how many were not present yet. */
+    uint32_t InsertBatch(T* p_values, uint32_t count) {
+        uint64_t hashes[Core::BATCH_SIZE];
+        uint32_t num_inserted = 0;
+        for (uint32_t batch = 0; batch < count; batch += Core::BATCH_SIZE) {
+            uint32_t batch_count = count - batch < Core::BATCH_SIZE ? count - batch : Core::BATCH_SIZE;
+            for (uint32_t i = 0; i < batch_count; i++) {
+                hashes[i] = Core::prefetch_key(p_values[batch + i]);
+            }
+            for (uint32_t i = 0; i < batch_count; i++) {
+                T& value = p_values[batch + i];
+                if (Core::emplace_hashed(value, hashes[i], std::move(value)).second) {
+                    num_inserted++;
+                }
+            }
+        }
+        return num_inserted;
+    }
+};
+
+struct HashMapKey {
+    template<class Pair>
+    const typename Pair::first_type& operator()(const Pair& value) const{
+        return value.first;
+    }
+};
+
+/* Map from K to V on the HashTable engine; the template flags are the same.
+Entries are std::pair<const K, V> stored in the cells, so a resize copies the
+keys: Reserve up front when the number of keys is known. */
+template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>,
+    class Allocator = std::allocator<std::pair<const K, V>>,
+    bool POW2_CAPACITY = true, bool STORE_HASH = false, bool INCREMENTAL_RESIZE = false, bool COLLECT_STATS = false>
+class HashMap : public HashTableCore<std::pair<const K, V>, K, HashMapKey, Hash, KeyEqual, Allocator,
+                                     POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS> {
+    using Core = HashTableCore<std::pair<const K, V>, K, HashMapKey, Hash, KeyEqual, Allocator,
+                               POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS>;
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+
+    using typename Core::iterator;
+    using Core::Core;
+    using Core::Erase;
+
+    /* Nothing is constructed when the key is present already, and otherwise
+    the entry is built in its cell from key and args. The second member of the
+    result is false if the key was present; running out of memory throws. */
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        return Core::emplace_key(key, std::piecewise_construct,
+                                 std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template<class... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return Core::emplace_key(key, std::piecewise_construct,
+                                 std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    /* A key and a mapped value are inserted like try_emplace. */
+    template<class KArg, class VArg, class = std::enable_if_t<std::is_same_v<std::decay_t<KArg>, K>>>
+    std::pair<iterator, bool> emplace(KArg&& key, VArg&& mapped) {
+        return Core::emplace_key(key, std::forward<KArg>(key), std::forward<VArg>(mapped));
+    }
+
+    /* Other arguments have to build the entry first to learn its key. */
+    template<class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return Core::emplace_key(value.first, std::move(value));
+    }
+
+    V& operator[](const K& key) {
+        return try_emplace(key).first->second;
+    }
+
+    V& operator[](K&& key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    bool Erase(const K& key) {
+        return Core::Erase(Core::Search(key));
+    }
+};
@@ -0,0 +1,418 @@
+#pragma once
+
+#include "hash_table.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* On disk snapshots of a HashTable.
+
+Tables of trivially copyable values are written in the FLAT format: a header
+followed by an occupancy bitmap and the slot array, everything addressed by
+offsets from the start of the file. MappedHashTable maps such a file read
+only and searches it in place, so opening it costs the same for any number of
+values. Tables of strings are written in the STREAM format, a header followed
+by length prefixed values.
+
+LoadHashTable reads either format back into a HashTable, reserving the whole
+capacity first instead of growing while inserting.
+
+The layout of a FLAT file depends on Hash, so the reader must use the hash
+function the writer used. std::hash of integers is the same everywhere, but
+that of other types may differ between builds. */
+struct HashTableSnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t value_size;
+    uint32_t value_align;
+    uint64_t seed;
+    uint32_t capacity;
+    uint32_t size;
+    uint64_t bitmap_offset;
+    uint64_t slots_offset;
+    uint64_t file_size;
+};
+
+static const char     HASH_TABLE_SNAPSHOT_MAGIC[8] = {'H', 'T', 'S', 'N', 'A', 'P', 0, 0};
+static const uint32_t HASH_TABLE_SNAPSHOT_VERSION = 1;
+static const uint32_t HASH_TABLE_SNAPSHOT_FLAT = 1;
+static const uint32_t HASH_TABLE_SNAPSHOT_STREAM = 2;
+
+/* Mixed into every hash of a FLAT file and kept in its header. */
+static const uint64_t HASH_TABLE_SNAPSHOT_SEED = 0x9E3779B97F4A7C15ull;
+
+/* Slots start on a cache line. */
+static const uint64_t HASH_TABLE_SNAPSHOT_ALIGNMENT = 64;
+
+/* Where a FLAT file puts a value, shared by the writer and the reader. Slots
+are probed linearly from the home slot, and a lookup stops at the first empty
+one. At most 80% of the slots are used. */
+struct HashTableSnapshotLayout {
+    static uint64_t mix(uint64_t hash, uint64_t seed) {
+        hash ^= seed;
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static uint32_t capacity_for(uint32_t num_values) {
+        uint64_t min_cap = ((uint64_t)num_values * 5 + 3) / 4;
+        uint32_t cap = 1;
+        while (cap < min_cap) {
+            cap *= 2;
+        }
+        return cap;
+    }
+
+    static uint32_t words_for(uint32_t cap) {
+        return (cap + 63) / 64;
+    }
+
+    static bool is_occupied(const uint64_t* p_words, uint32_t idx) {
+        return (p_words[idx / 64] >> (idx % 64)) & 1;
+    }
+
+    static uint64_t align_up(uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+};
+
+namespace hash_table_snapshot_detail {
+
+template<class T>
+struct is_string : std::false_type {};
+
+template<class CharT, class Traits, class Alloc>
+struct is_string<std::basic_string<CharT, Traits, Alloc>> : std::true_type {};
+
+inline bool write_all(FILE* p_file, const void* p_data, size_t size) {
+    return size == 0 || fwrite(p_data, 1, size, p_file) == size;
+}
+
+inline bool read_all(FILE* p_file, void* p_data, size_t size) {
+    return size == 0 || fread(p_data, 1, size, p_file) == size;
+}
+
+inline bool header_valid(const HashTableSnapshotHeader& header) {
+    return memcmp(header.magic, HASH_TABLE_SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 &&
+           header.version == HASH_TABLE_SNAPSHOT_VERSION;
+}
+
+}
+
+/* Write table to path, replacing the file. Returns false on any I/O error. */
+template<class T, class Hash, class Allocator, bool POW2_CAPACITY, bool STORE_HASH, bool INCREMENTAL_RESIZE,
+    bool COLLECT_STATS>
+bool SaveHashTable(const HashTable<T, Hash, Allocator, POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS>& table,
+                   const char* path) {
+    using namespace hash_table_snapshot_detail;
+    using Layout = HashTableSnapshotLayout;
+    static_assert(std::is_trivially_copyable_v<T> || is_string<T>::value,
+                  "Snapshots hold trivially copyable values or strings");
+
+    HashTableSnapshotHeader header = {};
+    memcpy(header.magic, HASH_TABLE_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = HASH_TABLE_SNAPSHOT_VERSION;
+    header.value_size = sizeof(T);
+    header.value_align = alignof(T);
+    header.size = table.Size();
+
+    FILE* p_file = fopen(path, "wb");
+    if (p_file == nullptr)
+        return false;
+
+    bool ok = true;
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        header.format = HASH_TABLE_SNAPSHOT_FLAT;
+        header.seed = HASH_TABLE_SNAPSHOT_SEED;
+        header.capacity = Layout::capacity_for(table.Size());
+        header.bitmap_offset = Layout::align_up(sizeof(header), HASH_TABLE_SNAPSHOT_ALIGNMENT);
+        header.slots_offset = Layout::align_up(header.bitmap_offset + Layout::words_for(header.capacity) * sizeof(uint64_t),
+                                               alignof(T) > HASH_TABLE_SNAPSHOT_ALIGNMENT ? alignof(T) : HASH_TABLE_SNAPSHOT_ALIGNMENT);
+        header.file_size = header.slots_offset + (uint64_t)header.capacity * sizeof(T);
+
+        /* The image of the whole file is built in memory, gaps and free slots
+        zeroed, and written in one go. */
+        std::vector<unsigned char> image(header.file_size, 0);
+        uint64_t* p_words = (uint64_t*)(image.data() + header.bitmap_offset);
+        unsigned char* p_slots = image.data() + header.slots_offset;
+        uint32_t mask = header.capacity - 1;
+        for (const T& value : table) {
+            uint32_t idx = (uint32_t)Layout::mix(Hash{}(value), header.seed) & mask;
+            while (Layout::is_occupied(p_words, idx)) {
+                idx = (idx + 1) & mask;
+            }
+            p_words[idx / 64] |= 1ull << (idx % 64);
+            memcpy(p_slots + (uint64_t)idx * sizeof(T), &value, sizeof(T));
+        }
+        memcpy(image.data(), &header, sizeof(header));
+
+        ok = write_all(p_file, image.data(), image.size());
+    }
+    else {
+        using Char = typename T::value_type;
+        header.format = HASH_TABLE_SNAPSHOT_STREAM;
+        header.value_size = sizeof(Char);
+        header.value_align = alignof(Char);
+
+        ok = write_all(p_file, &header, sizeof(header));
+        for (const T& value : table) {
+            if (!ok)
+                break;
+
+            uint64_t length = value.size();
+            ok = write_all(p_file, &length, sizeof(length)) && write_all(p_file, value.data(), length * sizeof(Char));
+        }
+    }
+
+    ok = fclose(p_file) == 0 && ok;
+    return ok;
+}
+
+/* Insert every value of the snapshot at path into table. Returns false if the
+file cannot be read or holds values of another type; values read before the
+error stay in the table. */
+template<class T, class Hash, class Allocator, bool POW2_CAPACITY, bool STORE_HASH, bool INCREMENTAL_RESIZE,
+    bool COLLECT_STATS>
+bool LoadHashTable(HashTable<T, Hash, Allocator, POW2_CAPACITY, STORE_HASH, INCREMENTAL_RESIZE, COLLECT_STATS>& table,
+                   const char* path) {
+    using namespace hash_table_snapshot_detail;
+    using Layout = HashTableSnapshotLayout;
+    static_assert(std::is_trivially_copyable_v<T> || is_string<T>::value,
+                  "Snapshots hold trivially copyable values or strings");
+
+    FILE* p_file = fopen(path, "rb");
+    if (p_file == nullptr)
+        return false;
+
+    HashTableSnapshotHeader header;
+    bool ok = read_all(p_file, &header, sizeof(header)) && header_valid(header);
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        ok = ok && header.format == HASH_TABLE_SNAPSHOT_FLAT && header.value_size == sizeof(T) &&
+             header.capacity != 0 && (header.capacity & (header.capacity - 1)) == 0;
+        if (ok) {
+            table.Reserve(table.Size() + header.size);
+
+            std::vector<uint64_t> words(Layout::words_for(header.capacity));
+            ok = fseek(p_file, header.bitmap_offset, SEEK_SET) == 0 &&
+                 read_all(p_file, words.data(), words.size() * sizeof(uint64_t)) &&
+                 fseek(p_file, header.slots_offset, SEEK_SET) == 0;
+
+            /* Slots are read in order a chunk at a time, free ones skipped. */
+            const uint32_t CHUNK_SLOTS = 4096;
+            std::vector<std::aligned_storage_t<sizeof(T), alignof(T)>> chunk(CHUNK_SLOTS);
+            const T* p_chunk = (const T*)chunk.data();
+            for (uint32_t base = 0; ok && base < header.capacity; base += CHUNK_SLOTS) {
+                uint32_t num_slots = header.capacity - base < CHUNK_SLOTS ? header.capacity - base : CHUNK_SLOTS;
+                ok = read_all(p_file, chunk.data(), num_slots * sizeof(T));
+                for (uint32_t i = 0; ok && i < num_slots; i++) {
+                    if (Layout::is_occupied(words.data(), base + i)) {
+                        table.Insert(T(p_chunk[i]));
+                    }
+                }
+            }
+        }
+    }
+    else {
+        using Char = typename T::value_type;
+        ok = ok && header.format == HASH_TABLE_SNAPSHOT_STREAM && header.value_size == sizeof(Char);
+        if (ok) {
+            table.Reserve(table.Size() + header.size);
+        }
+
+        for (uint32_t i = 0; ok && i < header.size; i++) {
+            uint64_t length;
+            ok = read_all(p_file, &length, sizeof(length));
+            if (ok) {
+                T value(length, Char());
+                ok = read_all(p_file, value.data(), length * sizeof(Char));
+                if (ok) {
+                    table.Insert(std::move(value));
+                }
+            }
+        }
+    }
+
+    fclose(p_file);
+    return ok;
+}
+
+/* Read only view of a FLAT snapshot, searched in place in a private read only
+mapping of the file. Nothing is read until a lookup touches it, so Open takes
+the same time for any size of table. Hash must be the hash the file was
+written with. */
+template<class T, class Hash = std::hash<T>>
+class MappedHashTable {
+    static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values can be mapped");
+
+    using Layout = HashTableSnapshotLayout;
+
+    void*           p_map;
+    size_t          map_size;
+    const uint64_t* p_words;
+    const T*        p_slots;
+    uint32_t        capacity;
+    uint32_t        size;
+    uint64_t        seed;
+
+    uint32_t next_occupied(uint32_t idx) const {
+        while (idx < capacity) {
+            uint64_t word = p_words[idx / 64] >> (idx % 64);
+            if (word != 0)
+                return idx + __builtin_ctzll(word);
+
+            idx = (idx / 64 + 1) * 64;
+        }
+        return capacity;
+    }
+
+public:
+    class iterator: public std::iterator< std::forward_iterator_tag, T> {
+        const MappedHashTable* p_table;
+        uint32_t               idx;
+    public:
+        explicit iterator(const MappedHashTable* i_p_table, uint32_t i_idx) : p_table(i_p_table),
+                                                                              idx(i_idx) {}
+        iterator& operator++() {
+            idx = p_table->next_occupied(idx + 1);
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator res = *this;
+            ++(*this);
+            return res;
+        }
+
+        bool operator==(iterator other) const{
+            return idx == other.idx;
+        }
+
+        bool operator!=(iterator other) const{
+            return !((*this) == other);
+        }
+
+        const T& operator*() const{
+            return p_table->p_slots[idx];
+        }
+    };
+
+    MappedHashTable() : p_map(nullptr),
+                        map_size(0),
+                        p_words(nullptr),
+                        p_slots(nullptr),
+                        capacity(0),
+                        size(0),
+                        seed(0) {}
+
+    MappedHashTable(const MappedHashTable&) = delete;
+    MappedHashTable& operator = (const MappedHashTable&) = delete;
+
+    ~MappedHashTable() {
+        Close();
+    }
+
+    /* Map the snapshot at path. Returns false, leaving the table closed, if
+    the file cannot be mapped or is not a FLAT snapshot of T. */
+    bool Open(const char* path) {
+        Close();
+
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(HashTableSnapshotHeader)) {
+            close(fd);
+            return false;
+        }
+
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+
+        const HashTableSnapshotHeader* p_header = (const HashTableSnapshotHeader*)p;
+        uint32_t cap = p_header->capacity;
+        if (!hash_table_snapshot_detail::header_valid(*p_header) ||
+            p_header->format != HASH_TABLE_SNAPSHOT_FLAT ||
+            p_header->value_size != sizeof(T) ||
+            cap == 0 || (cap & (cap - 1)) != 0 ||
+            p_header->file_size != (uint64_t)st.st_size ||
+            p_header->bitmap_offset + Layout::words_for(cap) * sizeof(uint64_t) > p_header->slots_offset ||
+            p_header->slots_offset % alignof(T) != 0 ||
+            p_header->slots_offset + (uint64_t)cap * sizeof(T) > p_header->file_size) {
+            munmap(p, st.st_size);
+            return false;
+        }
+
+        p_map = p;
+        map_size = st.st_size;
+        p_words = (const uint64_t*)((const char*)p + p_header->bitmap_offset);
+        p_slots = (const T*)((const char*)p + p_header->slots_offset);
+        capacity = cap;
+        size = p_header->size;
+        seed = p_header->seed;
+        return true;
+    }
+
+    void Close() {
+        if (p_map != nullptr) {
+            munmap(p_map, map_size);
+        }
+        p_map = nullptr;
+        map_size = 0;
+        p_words = nullptr;
+        p_slots = nullptr;
+        capacity = 0;
+        size = 0;
+    }
+
+    bool IsOpen() const {
+        return p_map != nullptr;
+    }
+
+    iterator begin() const{
+        return iterator(this, next_occupied(0));
+    }
+
+    iterator end() const{
+        return iterator(this, capacity);
+    }
+
+    iterator Search(const T& value) const{
+        if (capacity == 0)
+            return end();
+
+        uint32_t mask = capacity - 1;
+        uint32_t idx = (uint32_t)Layout::mix(Hash{}(value), seed) & mask;
+        for (uint32_t num_probe = 0; num_probe < capacity && Layout::is_occupied(p_words, idx); num_probe++) {
+            if (p_slots[idx] == value)
+                return iterator(this, idx);
+
+            idx = (idx + 1) & mask;
+        }
+        return end();
+    }
+
+    uint32_t Capacity() const{
+        return capacity;
+    }
+
+    uint32_t Size() const{
+        return size;
+    }
+};
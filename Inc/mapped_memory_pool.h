@@ -0,0 +1,167 @@
+#pragma once
+#include "memory_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Options of MappedMemoryPool, combined with |. */
+
+/* Back the pool with explicit huge pages (MAP_HUGETLB). They must have been
+reserved by the administrator; if none are left the pool falls back to
+regular pages with MAPPED_POOL_TRANSPARENT_HUGE_PAGES. */
+static const uint32_t MAPPED_POOL_HUGETLB = 1;
+/* Ask the kernel to back the pool with transparent huge pages where it can
+(madvise MADV_HUGEPAGE). The region is aligned to a huge page for that. */
+static const uint32_t MAPPED_POOL_TRANSPARENT_HUGE_PAGES = 2;
+/* Fault every page in when the pool is created (MAP_POPULATE), so that the
+first touches do not page fault later on a latency critical path. */
+static const uint32_t MAPPED_POOL_POPULATE = 4;
+
+/* The region of a MappedMemoryPool. A base of its own, so that the region is
+mapped before the arena lays out its blocks in it. */
+class MappedPoolRegion {
+	/* Huge page size of x86-64 and of arm64 with 4K pages. */
+	static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+	uint8_t* p_region;
+	size_t   size_mapping;
+	size_t   size_release_page;
+	bool     huge_tlb;
+
+	static size_t round_up(size_t size, size_t alignment) {
+		return (size + alignment - 1) & ~(alignment - 1);
+	}
+
+	/* Map size bytes aligned to alignment by mapping alignment more and
+	trimming both ends. */
+	static void* map_aligned(size_t size, size_t alignment, int flags) {
+		size_t size_reserved = size + alignment;
+		void* p_reserved = mmap(nullptr, size_reserved, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (p_reserved == MAP_FAILED)
+			return nullptr;
+
+		uintptr_t reserved_begin = (uintptr_t)p_reserved;
+		uintptr_t begin = (reserved_begin + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		uintptr_t end = begin + size;
+
+		if (begin != reserved_begin) {
+			munmap(p_reserved, begin - reserved_begin);
+		}
+		if (end != reserved_begin + size_reserved) {
+			munmap((void*)end, reserved_begin + size_reserved - end);
+		}
+
+		return (void*)begin;
+	}
+
+protected:
+	MappedPoolRegion(uint32_t size_pool, uint32_t options) : p_region(nullptr),
+															huge_tlb(false) {
+		int populate = (options & MAPPED_POOL_POPULATE) != 0 ? MAP_POPULATE : 0;
+
+		if ((options & MAPPED_POOL_HUGETLB) != 0) {
+			size_mapping = round_up(size_pool, HUGE_PAGE_SIZE);
+			void* p = mmap(nullptr, size_mapping, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+			if (p != MAP_FAILED) {
+				p_region = (uint8_t*)p;
+				size_release_page = HUGE_PAGE_SIZE;
+				huge_tlb = true;
+				return;
+			}
+			options |= MAPPED_POOL_TRANSPARENT_HUGE_PAGES;
+		}
+
+		size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+		if ((options & MAPPED_POOL_TRANSPARENT_HUGE_PAGES) != 0) {
+			/* Populating before the advice would fault in small pages, so the
+			pages are touched after it instead. */
+			size_mapping = round_up(size_pool, HUGE_PAGE_SIZE);
+			p_region = (uint8_t*)map_aligned(size_mapping, HUGE_PAGE_SIZE, MAP_PRIVATE | MAP_ANONYMOUS);
+			if (p_region == nullptr)
+				throw std::bad_alloc();
+
+			madvise(p_region, size_mapping, MADV_HUGEPAGE);
+			if (populate != 0) {
+				for (size_t offset = 0; offset < size_mapping; offset += page_size) {
+					((volatile uint8_t*)p_region)[offset] = 0;
+				}
+			}
+			/* Releasing less than a huge page would split it. */
+			size_release_page = HUGE_PAGE_SIZE;
+			return;
+		}
+
+		size_mapping = round_up(size_pool, page_size);
+		void* p = mmap(nullptr, size_mapping, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::bad_alloc();
+
+		p_region = (uint8_t*)p;
+		size_release_page = page_size;
+	}
+
+	~MappedPoolRegion() {
+		munmap(p_region, size_mapping);
+	}
+
+	uint8_t* region() const {
+		return p_region;
+	}
+
+	/* Hand the whole pages within size bytes at p back to the OS. They read
+	as zero when touched again. Returns the number of bytes released. */
+	size_t release(const uint8_t* p, size_t size) const {
+		uintptr_t begin = round_up((uintptr_t)p, size_release_page);
+		uintptr_t end = ((uintptr_t)p + size) & ~(uintptr_t)(size_release_page - 1);
+		if (end <= begin)
+			return 0;
+
+		if (madvise((void*)begin, end - begin, MADV_DONTNEED) != 0)
+			return 0;
+
+		return end - begin;
+	}
+
+public:
+	/* True if the pool got explicit huge pages. */
+	bool IsHugeTlb() const {
+		return huge_tlb;
+	}
+};
+
+/* MemoryPool whose region is mapped from the OS instead of being a member,
+so that its size is chosen at runtime and may be as large as the arena
+allows, just below 2 GB. The template flags are those of MemoryArena,
+options are the MAPPED_POOL_ flags above. The constructor throws
+std::bad_alloc if the region cannot be mapped.
+
+A pool with a runtime size cannot be the static pool of CustomAllocator;
+hand it to containers with PoolAllocator or MemoryPoolResource. */
+template<uint32_t SIZE_CLASS_LIMIT = 0, bool COLLECT_STATS = false, bool COMPACT_HEADERS = false>
+class MappedMemoryPool : public MappedPoolRegion, public MemoryArena<SIZE_CLASS_LIMIT, COLLECT_STATS, COMPACT_HEADERS> {
+	using Arena = MemoryArena<SIZE_CLASS_LIMIT, COLLECT_STATS, COMPACT_HEADERS>;
+
+public:
+	/* Free blocks smaller than this are not worth a system call each. */
+	static const uint32_t RELEASE_MIN_SIZE = 1 << 16;
+
+	explicit MappedMemoryPool(uint32_t size_pool, uint32_t options = 0) : MappedPoolRegion(size_pool, options),
+																		Arena(region(), size_pool) {}
+
+	/* Give the pages of free blocks of at least min_size bytes back to the
+	OS, e.g. after a burst, so that the resident size follows the working
+	set. The blocks stay free and are faulted in again when reused. Returns
+	the number of bytes released. */
+	size_t ReleaseFreePages(uint32_t min_size = RELEASE_MIN_SIZE) {
+		size_t size_released = 0;
+		Arena::ForEachFreeRange([&](const uint8_t* p, uint32_t size) {
+			if (size >= min_size) {
+				size_released += release(p, size);
+			}
+		});
+		return size_released;
+	}
+};
@@ -1,133 +1,342 @@
 #pragma once
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+
+/* Snapshot returned by MemoryArena::GetStats. The counters are only kept by
+arenas built with COLLECT_STATS and read 0 otherwise; the free list figures
+are gathered by walking the list when the snapshot is taken. */
+struct MemoryPoolStats {
+	/* Bin i counts requests of more than 2^(i-1) and at most 2^i bytes. */
+	static const uint32_t SIZE_BINS = 32;
+
+	uint64_t allocs_by_size[SIZE_BINS] = {};
+	uint64_t alloc_count = 0;
+	uint64_t free_count = 0;
+	uint64_t failed_allocs = 0;
+
+	/* Bytes not free, headers included, now and at most so far. */
+	uint32_t used_bytes = 0;
+	uint32_t peak_used_bytes = 0;
+
+	uint32_t free_bytes = 0;
+	uint32_t free_list_length = 0;
+	uint32_t cached_blocks = 0;
+	uint32_t largest_free_block = 0;
+
+	/* Share of the free bytes that a single request cannot get: 0 when all of
+	them are in one block, close to 1 when they are spread over small ones. */
+	double Fragmentation() const {
+		return free_bytes == 0 ? 0.0 : 1.0 - (double)largest_free_block / free_bytes;
+	}
 
-template<uint32_t SIZE_POOL>
-class MemoryPool {
+	std::string ToJson() const {
+		std::string json = "{\"alloc_count\":" + std::to_string(alloc_count) +
+			",\"free_count\":" + std::to_string(free_count) +
+			",\"failed_allocs\":" + std::to_string(failed_allocs) +
+			",\"used_bytes\":" + std::to_string(used_bytes) +
+			",\"peak_used_bytes\":" + std::to_string(peak_used_bytes) +
+			",\"free_bytes\":" + std::to_string(free_bytes) +
+			",\"free_list_length\":" + std::to_string(free_list_length) +
+			",\"cached_blocks\":" + std::to_string(cached_blocks) +
+			",\"largest_free_block\":" + std::to_string(largest_free_block) +
+			",\"fragmentation\":" + std::to_string(Fragmentation()) +
+			",\"allocs_by_size\":{";
+
+		/* Keyed by the upper bound of the bin, empty bins are left out. */
+		bool first = true;
+		for (uint32_t i = 0; i < SIZE_BINS; i++) {
+			if (allocs_by_size[i] == 0)
+				continue;
+
+			json += (first ? "\"" : ",\"") + std::to_string((uint64_t)1 << i) + "\":" + std::to_string(allocs_by_size[i]);
+			first = false;
+		}
+		return json + "}}";
+	}
+};
+
+/* Allocator over a region provided by the caller. MemoryPool below gives it
+inline storage; other pools hand it memory obtained elsewhere.
+
+SIZE_CLASS_LIMIT enables a size-class front end: freed blocks with a payload
+of up to SIZE_CLASS_LIMIT bytes are kept on segregated LIFO lists (one per
+BYTE_ALIGNMENT step) and handed out again in O(1) without touching the
+coalescing free list. 0 disables the front end.
+
+COLLECT_STATS makes the arena count its allocations for GetStats. Without it
+the counters take no space and no time.
+
+COMPACT_HEADERS shrinks the header of an allocated block from 16 to 8 bytes.
+The free list links are only needed while a block is free, so they move into
+its payload; allocated blocks keep just the two size words. Small objects
+then take 8 bytes less each, e.g. 24 instead of 32 bytes for a 16 byte
+object. The smallest block is still 16 bytes, so requests of at most 8 bytes
+gain nothing. */
+template<uint32_t SIZE_CLASS_LIMIT = 0, bool COLLECT_STATS = false, bool COMPACT_HEADERS = false>
+class MemoryArena {
+	/* Links are stored as 32 bit offsets from the start of the pool, which
+	leaves room in the header for the size of the physically preceding block.
+	That boundary tag lets Free find both neighbours of a block in O(1).
+
+	The size words come first: with COMPACT_HEADERS they are the whole header
+	and the links are the first bytes of the payload. */
 	struct BlockLink_t {
-		BlockLink_t* p_next_free_block;
-		uint32_t     size_block;
+		uint32_t size_prev_block;
+		uint32_t size_block;
+		uint32_t next_free_offset;
+		uint32_t prev_free_offset;
 	};
 
 public:
-	static const uint32_t SIZE_BLOCK_INFO = sizeof(BlockLink_t);
+	static const uint32_t SIZE_BLOCK_INFO = COMPACT_HEADERS ? offsetof(BlockLink_t, next_free_offset) : sizeof(BlockLink_t);
+	/* Every block must be able to hold the links once it is free. */
+	static const uint32_t MIN_SIZE_BLOCK = sizeof(BlockLink_t);
 	static const uint32_t BYTE_ALIGNMENT_MASK = 0x0007;
 	static const uint32_t BYTE_ALIGNMENT = 8;
 
-	static_assert(SIZE_POOL > SIZE_BLOCK_INFO * 2, "Size_pool is too small");
-	static_assert(SIZE_POOL < (1 << 31), "Size pool is too large");
-
 	static const uint32_t ALLOC_FLAG = (1 << 31);
+	/* Marks a block on a size class list when the links are in the payload
+	and cannot tell it apart from one owned by the application. Block sizes
+	are multiples of BYTE_ALIGNMENT, so the low bits are free. */
+	static const uint32_t CACHED_FLAG = 1;
+
+	static_assert((SIZE_CLASS_LIMIT & BYTE_ALIGNMENT_MASK) == 0, "Size class limit must be aligned");
+	static const uint32_t SIZE_CLASS_COUNT = SIZE_CLASS_LIMIT / BYTE_ALIGNMENT;
 
-	MemoryPool(const MemoryPool&) = delete;
-	MemoryPool(MemoryPool&&) = delete;
-	MemoryPool& operator = (const MemoryPool&) = delete;
-	MemoryPool& operator = (MemoryPool&&) = delete;
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena(MemoryArena&&) = delete;
+	MemoryArena& operator = (const MemoryArena&) = delete;
+	MemoryArena& operator = (MemoryArena&&) = delete;
 
 
 
 private:
+	/* Offset used as "no block". An allocated block has it as next_free_offset,
+unless the links are in the payload. */
+	static const uint32_t NO_BLOCK = 0xFFFFFFFF;
+	/* Terminator of the size class lists, so that a cached block never has
+	NO_BLOCK as its next_free_offset. */
+	static const uint32_t SIZE_CLASS_TAIL = 0xFFFFFFFE;
+
 	uint32_t free_bytes;
+	uint32_t allocated_blocks;
 
-	BlockLink_t  free_mem_start;
+	uint32_t     free_list_head;
 	BlockLink_t* p_free_mem_end;
-	uint8_t mem_pool[SIZE_POOL];
+	uint8_t*     mem_pool;
+
+	/* Heads of the segregated lists. A cached block keeps ALLOC_FLAG set, so the
+	coalescing list never sees it, and has a next_free_offset other than
+	NO_BLOCK, so Free can tell it apart from a block owned by the application. */
+	uint32_t size_class_lists[SIZE_CLASS_COUNT == 0 ? 1 : SIZE_CLASS_COUNT];
+	uint32_t cached_blocks;
+
+	struct Counters {
+		uint64_t allocs_by_size[MemoryPoolStats::SIZE_BINS];
+		uint64_t free_count;
+		uint64_t failed_allocs;
+		uint32_t total_bytes;
+		uint32_t min_free_bytes;
+	};
+	struct NoCounters {};
 
-	void insert_free_block(BlockLink_t* p_free_block_to_insert) {
-		BlockLink_t* p_iterator;
-		uint8_t *p_current_addr;
+	std::conditional_t<COLLECT_STATS, Counters, NoCounters> counters;
 
-		/* Iterate through the list until a block is found that has a higher address
-		than the block being inserted. */
-		for (p_iterator = &free_mem_start; p_iterator->p_next_free_block < p_free_block_to_insert;
-			p_iterator = p_iterator->p_next_free_block);
+	static uint32_t size_bin(uint32_t size) {
+		return size <= 1 ? 0 : 32 - __builtin_clz(size - 1);
+	}
 
+	/* Called after every request that may take bytes from the pool. */
+	void count_alloc(uint32_t size, const void* p) {
+		if constexpr (COLLECT_STATS) {
+			if (p == nullptr) {
+				counters.failed_allocs++;
+			}
+			else {
+				counters.allocs_by_size[size_bin(size)]++;
+			}
+			count_used();
+		}
+	}
 
-		/* Do the block being inserted, and the block it is being inserted after
-		make a contiguous block of memory? */
-		p_current_addr = (uint8_t *)p_iterator;
-		if ((p_current_addr + p_iterator->size_block) == (uint8_t *)p_free_block_to_insert) {
-			p_iterator->size_block += p_free_block_to_insert->size_block;
-			p_free_block_to_insert = p_iterator;
-			free_bytes += SIZE_BLOCK_INFO;
+	void count_used() {
+		if constexpr (COLLECT_STATS) {
+			if (free_bytes < counters.min_free_bytes) {
+				counters.min_free_bytes = free_bytes;
+			}
 		}
+	}
 
+	BlockLink_t* block_at(uint32_t offset) {
+		return (BlockLink_t*)(mem_pool + offset);
+	}
 
-		/* Do the block being inserted, and the block it is being inserted before
-		make a contiguous block of memory? */
-		p_current_addr = (uint8_t *)p_free_block_to_insert;
-		if ((p_current_addr + p_free_block_to_insert->size_block) == (uint8_t *)p_iterator->p_next_free_block) {
-			if (p_iterator->p_next_free_block != p_free_mem_end) {
-				/* Form one big block from the two blocks. */
-				p_free_block_to_insert->size_block += p_iterator->p_next_free_block->size_block;
-				p_free_block_to_insert->p_next_free_block = p_iterator->p_next_free_block->p_next_free_block;
-				free_bytes += SIZE_BLOCK_INFO;
-			}
-			else
-			{
-				p_free_block_to_insert->p_next_free_block = p_free_mem_end;
+	uint32_t offset_of(BlockLink_t* p_block) const {
+		return (uint32_t)((uint8_t*)p_block - mem_pool);
+	}
+
+	/* Tag a block handed to the application. */
+	static void mark_allocated(BlockLink_t* p_block) {
+		if constexpr (!COMPACT_HEADERS) {
+			p_block->next_free_offset = NO_BLOCK;
+		}
+	}
+
+	/* A block with ALLOC_FLAG is either owned by the application or parked
+	on a size class list. */
+	static bool is_cached(const BlockLink_t* p_block) {
+		if constexpr (COMPACT_HEADERS) {
+			return (p_block->size_block & CACHED_FLAG) != 0;
+		}
+		else {
+			return p_block->next_free_offset != NO_BLOCK;
+		}
+	}
+
+	BlockLink_t* next_physical_block(BlockLink_t* p_block) {
+		return (BlockLink_t*)((uint8_t*)p_block + (p_block->size_block & ~ALLOC_FLAG));
+	}
+
+	static bool is_size_class(uint32_t size_block) {
+		return SIZE_CLASS_COUNT != 0 && (size_block & BYTE_ALIGNMENT_MASK) == 0 &&
+			size_block > SIZE_BLOCK_INFO && size_block - SIZE_BLOCK_INFO <= SIZE_CLASS_LIMIT;
+	}
+
+	static uint32_t size_class_index(uint32_t size_block) {
+		return (size_block - SIZE_BLOCK_INFO) / BYTE_ALIGNMENT - 1;
+	}
+
+	/* Give every cached block back to the coalescing list, so that a request the
+	front end cannot serve gets a chance to use the merged space. */
+	void flush_size_classes() {
+		for (uint32_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+			uint32_t offset = size_class_lists[i];
+			while (offset != SIZE_CLASS_TAIL) {
+				BlockLink_t* p_block = block_at(offset);
+				offset = p_block->next_free_offset;
+				p_block->size_block &= ~(ALLOC_FLAG | CACHED_FLAG);
+				insert_free_block(p_block);
 			}
+			size_class_lists[i] = SIZE_CLASS_TAIL;
 		}
-		else
-		{
-			p_free_block_to_insert->p_next_free_block = p_iterator->p_next_free_block;
+
+		cached_blocks = 0;
+	}
+
+	void link_free_block(BlockLink_t* p_block) {
+		uint32_t offset = offset_of(p_block);
+
+		p_block->prev_free_offset = NO_BLOCK;
+		p_block->next_free_offset = free_list_head;
+		if (free_list_head != NO_BLOCK) {
+			block_at(free_list_head)->prev_free_offset = offset;
 		}
+		free_list_head = offset;
+	}
 
+	void unlink_free_block(BlockLink_t* p_block) {
+		if (p_block->prev_free_offset != NO_BLOCK) {
+			block_at(p_block->prev_free_offset)->next_free_offset = p_block->next_free_offset;
+		}
+		else {
+			free_list_head = p_block->next_free_offset;
+		}
 
-		if (p_iterator != p_free_block_to_insert)
-		{
-			p_iterator->p_next_free_block = p_free_block_to_insert;
+		if (p_block->next_free_offset != NO_BLOCK) {
+			block_at(p_block->next_free_offset)->prev_free_offset = p_block->prev_free_offset;
 		}
 	}
 
-public:
-	MemoryPool() {
-		BlockLink_t *p_first_free_block;
+	void insert_free_block(BlockLink_t* p_free_block_to_insert) {
+		BlockLink_t* p_neighbour;
+
+		/* Is the block physically after this one free? The end marker is
+		always flagged as allocated, so it is never merged. */
+		p_neighbour = next_physical_block(p_free_block_to_insert);
+		if ((p_neighbour->size_block & ALLOC_FLAG) == 0) {
+			/* Form one big block from the two blocks. */
+			unlink_free_block(p_neighbour);
+			p_free_block_to_insert->size_block += p_neighbour->size_block;
+			free_bytes += SIZE_BLOCK_INFO;
+		}
 
-		free_mem_start.p_next_free_block = (BlockLink_t*)mem_pool;
-		free_mem_start.size_block = 0;
+		/* Is the block physically before this one free? The first block of the
+		pool has no predecessor. */
+		if (p_free_block_to_insert->size_prev_block != 0) {
+			p_neighbour = (BlockLink_t*)((uint8_t*)p_free_block_to_insert - p_free_block_to_insert->size_prev_block);
+			if ((p_neighbour->size_block & ALLOC_FLAG) == 0) {
+				unlink_free_block(p_neighbour);
+				p_neighbour->size_block += p_free_block_to_insert->size_block;
+				p_free_block_to_insert = p_neighbour;
+				free_bytes += SIZE_BLOCK_INFO;
+			}
+		}
 
-		p_free_mem_end = (BlockLink_t*)(mem_pool + SIZE_POOL - SIZE_BLOCK_INFO);
-		p_free_mem_end->size_block = 0;
-		p_free_mem_end->p_next_free_block = nullptr;
+		next_physical_block(p_free_block_to_insert)->size_prev_block = p_free_block_to_insert->size_block;
+		link_free_block(p_free_block_to_insert);
+	}
 
-		p_first_free_block = (BlockLink_t*)(mem_pool);
-		p_first_free_block->size_block = SIZE_POOL - SIZE_BLOCK_INFO;
+	/* Offset from the start of a free block to the header of a block whose
+	payload is aligned to alignment. A non zero offset must leave room for a
+	free block in front. */
+	static uint32_t aligned_block_offset(BlockLink_t* p_block, uint32_t alignment) {
+		uintptr_t payload = (uintptr_t)p_block + SIZE_BLOCK_INFO;
+		uint32_t offset = (uint32_t)(((payload + alignment - 1) & ~(uintptr_t)(alignment - 1)) - payload);
 
-		p_first_free_block->p_next_free_block = p_free_mem_end;
+		if (offset != 0 && offset <= SIZE_BLOCK_INFO) {
+			offset += alignment;
+		}
 
-		free_bytes = p_first_free_block->size_block - SIZE_BLOCK_INFO;
+		return offset;
 	}
 
-	void* Alloc(uint32_t wanted_size) {
+	void* alloc_from_free_list(uint32_t wanted_size, uint32_t alignment) {
 		BlockLink_t* p_current_block;
-		BlockLink_t* p_prev_block;
 		BlockLink_t* p_new_block;
+		uint32_t offset;
+		uint32_t lead_size = 0;
 
 		void *p_return = nullptr;
 
-		wanted_size += SIZE_BLOCK_INFO;
-
-		if ((wanted_size & BYTE_ALIGNMENT_MASK) != 0x00) {
-			/* Byte alignment required. */
-			wanted_size += (BYTE_ALIGNMENT - (wanted_size & BYTE_ALIGNMENT_MASK));
-		}
-
 		if (wanted_size <= free_bytes + SIZE_BLOCK_INFO) {
-			p_prev_block = &free_mem_start;
-			p_current_block = free_mem_start.p_next_free_block;
-			while ((p_current_block->size_block < wanted_size) && (p_current_block->p_next_free_block != nullptr)) {
-				p_prev_block = p_current_block;
-				p_current_block = p_current_block->p_next_free_block;
+			p_current_block = nullptr;
+			for (offset = free_list_head; offset != NO_BLOCK; offset = p_current_block->next_free_offset) {
+				p_current_block = block_at(offset);
+				if (alignment > BYTE_ALIGNMENT) {
+					lead_size = aligned_block_offset(p_current_block, alignment);
+				}
+				if (p_current_block->size_block >= wanted_size + lead_size)
+					break;
 			}
 
-			if (p_current_block != p_free_mem_end) {
-				/* Return the memory space pointed to - jumping over the
-				BlockLink_t structure at its start. */
-				p_return = (void *)(((uint8_t *)p_prev_block->p_next_free_block) + SIZE_BLOCK_INFO);
-
+			if (offset != NO_BLOCK) {
 				/* This block is being returned for use so must be taken out
 				of the list of free blocks. */
-				p_prev_block->p_next_free_block = p_current_block->p_next_free_block;
+				unlink_free_block(p_current_block);
+
+				/* For an aligned request the part in front of the aligned
+				payload stays free. Its physical predecessor is not free,
+				otherwise the two would have been merged. */
+				if (lead_size != 0) {
+					p_new_block = (BlockLink_t *)(((uint8_t *)p_current_block) + lead_size);
+					p_new_block->size_block = p_current_block->size_block - lead_size;
+					p_new_block->size_prev_block = lead_size;
+					p_current_block->size_block = lead_size;
+					free_bytes -= SIZE_BLOCK_INFO;
+
+					next_physical_block(p_new_block)->size_prev_block = p_new_block->size_block;
+					link_free_block(p_current_block);
+					p_current_block = p_new_block;
+				}
+
+				/* Return the memory space pointed to - jumping over the
+				BlockLink_t structure at its start. */
+				p_return = (void *)(((uint8_t *)p_current_block) + SIZE_BLOCK_INFO);
 
 				/* If the block is larger than required it can be split into
 				two. */
@@ -138,11 +347,14 @@ public:
 					/* Calculate the sizes of two blocks split from the
 					single block. */
 					p_new_block->size_block = p_current_block->size_block - wanted_size;
+					p_new_block->size_prev_block = wanted_size;
 					p_current_block->size_block = wanted_size;
 					free_bytes -= SIZE_BLOCK_INFO;
 
-					/* Insert the new block into the list of free blocks. */
-					insert_free_block(p_new_block);
+					/* The block after the new one is never free, otherwise it
+					would have been merged already. */
+					next_physical_block(p_new_block)->size_prev_block = p_new_block->size_block;
+					link_free_block(p_new_block);
 				}
 
 				free_bytes -= p_current_block->size_block - SIZE_BLOCK_INFO;
@@ -151,14 +363,180 @@ public:
 				by the application and has no "next" block. */
 
 				p_current_block->size_block |= ALLOC_FLAG;
-				p_current_block->p_next_free_block = nullptr;
+				mark_allocated(p_current_block);
+			}
+
+		}
+
+		return p_return;
+	}
+
+	/* Size of the block that holds wanted_size bytes of payload. */
+	static uint32_t block_size_for(uint32_t wanted_size) {
+		wanted_size += SIZE_BLOCK_INFO;
+
+		if ((wanted_size & BYTE_ALIGNMENT_MASK) != 0x00) {
+			/* Byte alignment required. */
+			wanted_size += (BYTE_ALIGNMENT - (wanted_size & BYTE_ALIGNMENT_MASK));
+		}
+
+		if (wanted_size < MIN_SIZE_BLOCK) {
+			wanted_size = MIN_SIZE_BLOCK;
+		}
+
+		return wanted_size;
+	}
+
+	/* Mark p_block, which spans size_total bytes that are not counted as free,
+	as an allocated block of wanted_size bytes. A remainder large enough to
+	hold a block is given back to the free list. */
+	void set_allocated_size(BlockLink_t* p_block, uint32_t size_total, uint32_t wanted_size) {
+		BlockLink_t* p_new_block;
+
+		mark_allocated(p_block);
+
+		if ((size_total - wanted_size) > SIZE_BLOCK_INFO) {
+			p_block->size_block = wanted_size | ALLOC_FLAG;
+
+			p_new_block = (BlockLink_t *)(((uint8_t *)p_block) + wanted_size);
+			p_new_block->size_block = size_total - wanted_size;
+			p_new_block->size_prev_block = wanted_size;
+			free_bytes += p_new_block->size_block - SIZE_BLOCK_INFO;
+
+			/* The block after the remainder may be free, so it goes through
+			the merging path. */
+			insert_free_block(p_new_block);
+		}
+		else {
+			p_block->size_block = size_total | ALLOC_FLAG;
+			next_physical_block(p_block)->size_prev_block = size_total;
+		}
+	}
+
+	/* Take a free neighbour out of the free list so that it can become part
+	of an allocated block. */
+	void absorb_free_block(BlockLink_t* p_block) {
+		unlink_free_block(p_block);
+		free_bytes -= p_block->size_block - SIZE_BLOCK_INFO;
+	}
+
+public:
+	MemoryArena(void* p_region, uint32_t size_region) {
+		BlockLink_t *p_first_free_block;
+
+		assert(((uintptr_t)p_region & BYTE_ALIGNMENT_MASK) == 0);
+		assert(size_region < ALLOC_FLAG);
+
+		/* CACHED_FLAG needs every block size to be aligned, the last one
+		included. */
+		if constexpr (COMPACT_HEADERS) {
+			size_region &= ~BYTE_ALIGNMENT_MASK;
+		}
+		assert(size_region > MIN_SIZE_BLOCK + SIZE_BLOCK_INFO);
+
+		mem_pool = (uint8_t*)p_region;
+
+		p_first_free_block = (BlockLink_t*)(mem_pool);
+		p_first_free_block->size_block = size_region - SIZE_BLOCK_INFO;
+		p_first_free_block->size_prev_block = 0;
+
+		p_free_mem_end = (BlockLink_t*)(mem_pool + size_region - SIZE_BLOCK_INFO);
+		p_free_mem_end->size_block = ALLOC_FLAG;
+		p_free_mem_end->size_prev_block = p_first_free_block->size_block;
+		mark_allocated(p_free_mem_end);
+
+		free_list_head = NO_BLOCK;
+		link_free_block(p_first_free_block);
+
+		free_bytes = p_first_free_block->size_block - SIZE_BLOCK_INFO;
+		allocated_blocks = 0;
+
+		for (uint32_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+			size_class_lists[i] = SIZE_CLASS_TAIL;
+		}
+		cached_blocks = 0;
+
+		if constexpr (COLLECT_STATS) {
+			counters = Counters();
+			counters.total_bytes = free_bytes;
+			counters.min_free_bytes = free_bytes;
+		}
+	}
+
+	void* Alloc(uint32_t wanted_size) {
+		BlockLink_t* p_current_block;
+		void *p_return;
+		uint32_t requested_size = wanted_size;
+
+		wanted_size = block_size_for(wanted_size);
+
+		if (is_size_class(wanted_size)) {
+			uint32_t idx = size_class_index(wanted_size);
+			if (size_class_lists[idx] != SIZE_CLASS_TAIL) {
+				p_current_block = block_at(size_class_lists[idx]);
+				size_class_lists[idx] = p_current_block->next_free_offset;
+				cached_blocks--;
+
+				/* The block keeps ALLOC_FLAG while it is cached. */
+				p_current_block->size_block &= ~CACHED_FLAG;
+				free_bytes -= (p_current_block->size_block & ~ALLOC_FLAG) - SIZE_BLOCK_INFO;
+				mark_allocated(p_current_block);
+				allocated_blocks++;
+
+				p_return = (void *)(((uint8_t *)p_current_block) + SIZE_BLOCK_INFO);
+				count_alloc(requested_size, p_return);
+				return p_return;
 			}
+		}
+
+		p_return = alloc_from_free_list(wanted_size, BYTE_ALIGNMENT);
+		if (p_return == nullptr && cached_blocks != 0) {
+			flush_size_classes();
+			p_return = alloc_from_free_list(wanted_size, BYTE_ALIGNMENT);
+		}
 
+		if (p_return != nullptr) {
+			allocated_blocks++;
 		}
 
+		count_alloc(requested_size, p_return);
 		return p_return;
 	}
 
+	/* Alloc with the payload aligned to alignment, a power of two. The space
+	skipped in front of the payload is split off as a free block, so at most
+	alignment + SIZE_BLOCK_INFO bytes are set aside, and only while the block
+	in front stays unused. The block is released with Free. */
+	void* AllocAligned(uint32_t wanted_size, uint32_t alignment) {
+		void *p_return;
+		uint32_t requested_size = wanted_size;
+
+		assert((alignment & (alignment - 1)) == 0);
+		if (alignment <= BYTE_ALIGNMENT)
+			return Alloc(wanted_size);
+
+		wanted_size = block_size_for(wanted_size);
+
+		/* Cached blocks are not checked for alignment, the request always
+		goes to the coalescing list. */
+		p_return = alloc_from_free_list(wanted_size, alignment);
+		if (p_return == nullptr && cached_blocks != 0) {
+			flush_size_classes();
+			p_return = alloc_from_free_list(wanted_size, alignment);
+		}
+
+		if (p_return != nullptr) {
+			allocated_blocks++;
+		}
+
+		count_alloc(requested_size, p_return);
+		return p_return;
+	}
+
+	void* Alloc(uint32_t wanted_size, std::align_val_t alignment) {
+		return AllocAligned(wanted_size, (uint32_t)alignment);
+	}
+
 	void Free(void* p) {
 		uint8_t *p_free_addr = (uint8_t *)p;
 		BlockLink_t* p_free_block;
@@ -169,22 +547,209 @@ public:
 			p_free_block = (BlockLink_t*)p_free_addr;
 
 			if ((p_free_block->size_block & ALLOC_FLAG) != 0) {
-				if (p_free_block->p_next_free_block == nullptr)
+				if (!is_cached(p_free_block))
 				{
+					uint32_t size_block = p_free_block->size_block & ~ALLOC_FLAG;
+
 					/* The block is being returned to the heap - it is no longer
 					allocated. */
-					p_free_block->size_block &= ~ALLOC_FLAG;
+					free_bytes += size_block - SIZE_BLOCK_INFO;
+					allocated_blocks--;
+					if constexpr (COLLECT_STATS) {
+						counters.free_count++;
+					}
+
+					if (is_size_class(size_block)) {
+						/* Small blocks are parked on their size class list and
+						stay invisible to the coalescing list. */
+						uint32_t idx = size_class_index(size_block);
+						if constexpr (COMPACT_HEADERS) {
+							p_free_block->size_block |= CACHED_FLAG;
+						}
+						p_free_block->next_free_offset = size_class_lists[idx];
+						size_class_lists[idx] = offset_of(p_free_block);
+						cached_blocks++;
+					}
+					else {
+						/* Add this block to the list of free blocks. */
+						p_free_block->size_block = size_block;
+						insert_free_block(p_free_block);
+					}
+				}
+			}
+		}
+	}
+
+	/* Grow a block without moving it, using the free block physically after
+	it. Returns false, leaving the block untouched, when there is not enough
+	room. A block that is already large enough is left as it is. */
+	bool TryExpand(void* p, uint32_t new_size) {
+		BlockLink_t* p_block = (BlockLink_t*)((uint8_t*)p - SIZE_BLOCK_INFO);
+		uint32_t size_block = p_block->size_block & ~ALLOC_FLAG;
+		uint32_t wanted_size = block_size_for(new_size);
+
+		if (wanted_size <= size_block)
+			return true;
+
+		BlockLink_t* p_next_block = next_physical_block(p_block);
+		if ((p_next_block->size_block & ALLOC_FLAG) != 0 ||
+			size_block + p_next_block->size_block < wanted_size)
+			return false;
+
+		absorb_free_block(p_next_block);
+		set_allocated_size(p_block, size_block + p_next_block->size_block, wanted_size);
+		count_used();
+		return true;
+	}
+
+	/* Give the tail of a block back to the pool. Tails too small to hold a
+	block stay with it. */
+	void Shrink(void* p, uint32_t new_size) {
+		BlockLink_t* p_block = (BlockLink_t*)((uint8_t*)p - SIZE_BLOCK_INFO);
+		uint32_t size_block = p_block->size_block & ~ALLOC_FLAG;
+		uint32_t wanted_size = block_size_for(new_size);
+
+		if (wanted_size < size_block) {
+			set_allocated_size(p_block, size_block, wanted_size);
+		}
+	}
+
+	/* Resize a block, moving it only when neither neighbour can make room.
+	The free block in front is used by moving the payload down within the
+	merged space. On failure nullptr is returned and the block is left as it
+	was. Moved blocks get the default alignment, so blocks from AllocAligned
+	should be grown with TryExpand. */
+	void* Realloc(void* p, uint32_t new_size) {
+		if (p == nullptr)
+			return Alloc(new_size);
+
+		BlockLink_t* p_block = (BlockLink_t*)((uint8_t*)p - SIZE_BLOCK_INFO);
+		uint32_t size_block = p_block->size_block & ~ALLOC_FLAG;
+		uint32_t wanted_size = block_size_for(new_size);
+
+		if (wanted_size <= size_block) {
+			Shrink(p, new_size);
+			return p;
+		}
+
+		if (TryExpand(p, new_size))
+			return p;
 
+		if (p_block->size_prev_block != 0) {
+			BlockLink_t* p_prev_block = (BlockLink_t*)((uint8_t*)p_block - p_block->size_prev_block);
+			BlockLink_t* p_next_block = next_physical_block(p_block);
+			uint32_t size_total = size_block;
+			uint32_t size_next = 0;
 
-					/* Add this block to the list of free blocks. */
-					free_bytes += p_free_block->size_block - SIZE_BLOCK_INFO;
-					insert_free_block(p_free_block);
+			if ((p_prev_block->size_block & ALLOC_FLAG) == 0) {
+				size_total += p_prev_block->size_block;
+				if ((p_next_block->size_block & ALLOC_FLAG) == 0) {
+					size_next = p_next_block->size_block;
 				}
 			}
+
+			if (size_total != size_block && size_total + size_next >= wanted_size) {
+				absorb_free_block(p_prev_block);
+				if (size_total < wanted_size) {
+					absorb_free_block(p_next_block);
+					size_total += size_next;
+				}
+
+				void* p_return = (uint8_t*)p_prev_block + SIZE_BLOCK_INFO;
+				memmove(p_return, p, size_block - SIZE_BLOCK_INFO);
+				set_allocated_size(p_prev_block, size_total, wanted_size);
+				count_used();
+				return p_return;
+			}
+		}
+
+		void* p_return = Alloc(new_size);
+		if (p_return != nullptr) {
+			memcpy(p_return, p, size_block - SIZE_BLOCK_INFO);
+			Free(p);
 		}
+
+		return p_return;
 	}
 
 	uint32_t GetFreeBytes() const {
 		return free_bytes;
 	}
+
+	/* Number of blocks owned by the application. Blocks parked on the size
+	class lists are not counted. */
+	uint32_t GetAllocatedBlocks() const {
+		return allocated_blocks;
+	}
+
+	/* Call f(p, size) for every block on the coalescing list with the bytes
+	of it past its header and links. The arena does not read them while the
+	block stays free, so their pages may be handed back to the OS. Blocks on
+	the size class lists are left out. */
+	template<class F>
+	void ForEachFreeRange(F f) const {
+		for (uint32_t offset = free_list_head; offset != NO_BLOCK; ) {
+			const BlockLink_t* p_block = (const BlockLink_t*)(mem_pool + offset);
+			if (p_block->size_block > sizeof(BlockLink_t)) {
+				f((uint8_t*)p_block + sizeof(BlockLink_t), p_block->size_block - (uint32_t)sizeof(BlockLink_t));
+			}
+			offset = p_block->next_free_offset;
+		}
+	}
+
+	/* Walks the free list, so it costs time proportional to its length. */
+	MemoryPoolStats GetStats() const {
+		MemoryPoolStats stats;
+
+		if constexpr (COLLECT_STATS) {
+			for (uint32_t i = 0; i < MemoryPoolStats::SIZE_BINS; i++) {
+				stats.allocs_by_size[i] = counters.allocs_by_size[i];
+				stats.alloc_count += counters.allocs_by_size[i];
+			}
+			stats.free_count = counters.free_count;
+			stats.failed_allocs = counters.failed_allocs;
+			stats.used_bytes = counters.total_bytes - free_bytes;
+			stats.peak_used_bytes = counters.total_bytes - counters.min_free_bytes;
+		}
+
+		stats.free_bytes = free_bytes;
+		stats.cached_blocks = cached_blocks;
+		for (uint32_t offset = free_list_head; offset != NO_BLOCK; ) {
+			const BlockLink_t* p_block = (const BlockLink_t*)(mem_pool + offset);
+			if (p_block->size_block - SIZE_BLOCK_INFO > stats.largest_free_block) {
+				stats.largest_free_block = p_block->size_block - SIZE_BLOCK_INFO;
+			}
+			stats.free_list_length++;
+			offset = p_block->next_free_offset;
+		}
+
+		return stats;
+	}
+
+	/* Number of usable bytes in a block returned by Alloc. It can be larger
+	than the requested size when the remainder was too small to split off. */
+	static uint32_t GetBlockSize(const void* p) {
+		const BlockLink_t* p_block = (const BlockLink_t*)((const uint8_t*)p - SIZE_BLOCK_INFO);
+		return (p_block->size_block & ~ALLOC_FLAG) - SIZE_BLOCK_INFO;
+	}
+};
+
+/* Storage comes first in the base list, so it exists before the arena lays
+out its blocks in it. */
+template<uint32_t SIZE_POOL>
+struct MemoryPoolStorage {
+	alignas(MemoryArena<>::BYTE_ALIGNMENT) uint8_t mem_pool[SIZE_POOL];
+};
+
+template<uint32_t SIZE_POOL, uint32_t SIZE_CLASS_LIMIT = 0, bool COLLECT_STATS = false, bool COMPACT_HEADERS = false>
+class MemoryPool : private MemoryPoolStorage<SIZE_POOL>, public MemoryArena<SIZE_CLASS_LIMIT, COLLECT_STATS, COMPACT_HEADERS> {
+	using Storage = MemoryPoolStorage<SIZE_POOL>;
+	using Arena = MemoryArena<SIZE_CLASS_LIMIT, COLLECT_STATS, COMPACT_HEADERS>;
+
+public:
+	static_assert((COMPACT_HEADERS ? SIZE_POOL & ~Arena::BYTE_ALIGNMENT_MASK : SIZE_POOL) > Arena::MIN_SIZE_BLOCK + Arena::SIZE_BLOCK_INFO,
+		"Size_pool is too small");
+	static_assert(SIZE_POOL < (1 << 31), "Size pool is too large");
+
+	MemoryPool() : Arena(Storage::mem_pool, SIZE_POOL) {}
 };
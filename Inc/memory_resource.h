@@ -0,0 +1,145 @@
+#pragma once
+#include "memory_pool.h"
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+/* std::pmr::memory_resource over any pool with Alloc/Free, so pmr containers
+can pick their pool at runtime. The pool is not owned and must outlive the
+resource. Two resources are equal only if they are the same object. */
+template<class Pool>
+class MemoryPoolResource : public std::pmr::memory_resource {
+	Pool* p_pool;
+
+public:
+	explicit MemoryPoolResource(Pool& pool) : p_pool(&pool) {}
+
+	Pool& GetPool() const {
+		return *p_pool;
+	}
+
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		if (bytes > UINT32_MAX || alignment > UINT32_MAX)
+			throw std::bad_alloc();
+
+		void* p = p_pool->AllocAligned((uint32_t)bytes, (uint32_t)alignment);
+		if (p == nullptr)
+			throw std::bad_alloc();
+
+		return p;
+	}
+
+	void do_deallocate(void* p, std::size_t, std::size_t) override {
+		p_pool->Free(p);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+};
+
+/* Bump pointer arena. deallocate does nothing; memory comes back only through
+Release, which rewinds the arena to the start of its first buffer. Buffers are
+taken from the upstream resource, each one twice as large as the one before.
+The first buffer is kept across Release, so an arena reused per request only
+touches the upstream when a request outgrows it. */
+class MonotonicArenaResource : public std::pmr::memory_resource {
+	struct Buffer {
+		Buffer*     p_next_buffer;
+		std::size_t size_buffer;
+	};
+
+	/* Buffers are only asked to be aligned like Buffer, which any pool can
+	provide; stricter alignments are handled when bumping. */
+	static const std::size_t SIZE_BUFFER_INFO = sizeof(Buffer);
+
+	std::pmr::memory_resource* p_upstream;
+	Buffer*                    p_first_buffer;
+	Buffer*                    p_buffers;
+	std::size_t                next_size_buffer;
+	uint8_t*                   p_bump;
+	uint8_t*                   p_bump_end;
+
+	void add_buffer(std::size_t bytes, std::size_t alignment) {
+		std::size_t size_buffer = next_size_buffer;
+		while (size_buffer < SIZE_BUFFER_INFO + bytes + alignment) {
+			size_buffer *= 2;
+		}
+
+		Buffer* p_buffer = (Buffer*)p_upstream->allocate(size_buffer, alignof(Buffer));
+		p_buffer->size_buffer = size_buffer;
+
+		if (p_first_buffer == nullptr) {
+			p_buffer->p_next_buffer = nullptr;
+			p_first_buffer = p_buffer;
+		}
+		else {
+			p_buffer->p_next_buffer = p_buffers;
+			p_buffers = p_buffer;
+		}
+
+		p_bump = (uint8_t*)p_buffer + SIZE_BUFFER_INFO;
+		p_bump_end = (uint8_t*)p_buffer + size_buffer;
+		next_size_buffer = size_buffer * 2;
+	}
+
+public:
+	explicit MonotonicArenaResource(std::size_t initial_size,
+									std::pmr::memory_resource* p_upstream_resource = std::pmr::get_default_resource()) :
+		p_upstream(p_upstream_resource),
+		p_first_buffer(nullptr),
+		p_buffers(nullptr),
+		next_size_buffer(initial_size > SIZE_BUFFER_INFO ? initial_size : 2 * SIZE_BUFFER_INFO),
+		p_bump(nullptr),
+		p_bump_end(nullptr) {}
+
+	~MonotonicArenaResource() {
+		Release();
+		if (p_first_buffer != nullptr) {
+			p_upstream->deallocate(p_first_buffer, p_first_buffer->size_buffer, alignof(Buffer));
+		}
+	}
+
+	MonotonicArenaResource(const MonotonicArenaResource&) = delete;
+	MonotonicArenaResource& operator = (const MonotonicArenaResource&) = delete;
+
+	/* Forget every allocation at once. Only the buffers added after the first
+	one are handed back to the upstream resource. */
+	void Release() {
+		while (p_buffers != nullptr) {
+			Buffer* p_buffer = p_buffers;
+			p_buffers = p_buffer->p_next_buffer;
+			p_upstream->deallocate(p_buffer, p_buffer->size_buffer, alignof(Buffer));
+		}
+
+		if (p_first_buffer != nullptr) {
+			p_bump = (uint8_t*)p_first_buffer + SIZE_BUFFER_INFO;
+			p_bump_end = (uint8_t*)p_first_buffer + p_first_buffer->size_buffer;
+			next_size_buffer = p_first_buffer->size_buffer * 2;
+		}
+	}
+
+	std::pmr::memory_resource* GetUpstream() const {
+		return p_upstream;
+	}
+
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		uintptr_t p_aligned = ((uintptr_t)p_bump + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		if (p_bump == nullptr || p_aligned + bytes > (uintptr_t)p_bump_end) {
+			add_buffer(bytes, alignment);
+			p_aligned = ((uintptr_t)p_bump + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		}
+
+		p_bump = (uint8_t*)(p_aligned + bytes);
+		return (void*)p_aligned;
+	}
+
+	void do_deallocate(void*, std::size_t, std::size_t) override {
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+};
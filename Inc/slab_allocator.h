@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/* Object pool for a single object size. Objects carry no header: a free
+object holds the link of an intrusive free list in its own storage. Memory is
+taken from the backing pool in slabs of SLAB_SIZE bytes and carved out lazily
+with a bump pointer. When the pool cannot provide a full slab, smaller slabs
+are tried down to one that holds a single object.
+
+Slabs are kept until the SlabPool is destroyed. */
+template<uint32_t OBJECT_SIZE, uint32_t OBJECT_ALIGNMENT, class Pool>
+class SlabPool {
+	struct FreeObject {
+		FreeObject* p_next;
+	};
+
+	struct Slab {
+		Slab* p_next_slab;
+	};
+
+	static const uint32_t SLOT_ALIGNMENT = OBJECT_ALIGNMENT > alignof(FreeObject) ? OBJECT_ALIGNMENT : alignof(FreeObject);
+	static const uint32_t SLOT_RAW_SIZE = OBJECT_SIZE > sizeof(FreeObject) ? OBJECT_SIZE : sizeof(FreeObject);
+
+public:
+	static const uint32_t SLAB_SIZE = 4096;
+	static const uint32_t SLOT_SIZE = (SLOT_RAW_SIZE + SLOT_ALIGNMENT - 1) & ~(SLOT_ALIGNMENT - 1);
+
+	static_assert((OBJECT_ALIGNMENT & (OBJECT_ALIGNMENT - 1)) == 0, "Alignment must be a power of two");
+
+	SlabPool(const SlabPool&) = delete;
+	SlabPool(SlabPool&&) = delete;
+	SlabPool& operator = (const SlabPool&) = delete;
+	SlabPool& operator = (SlabPool&&) = delete;
+
+private:
+	Pool*       p_pool;
+	FreeObject* p_free_objects;
+	Slab*       p_slabs;
+	uint8_t*    p_bump;
+	uint8_t*    p_bump_end;
+
+	static uint8_t* align_up(uint8_t* p) {
+		return (uint8_t*)(((uintptr_t)p + SLOT_ALIGNMENT - 1) & ~(uintptr_t)(SLOT_ALIGNMENT - 1));
+	}
+
+	bool add_slab() {
+		/* Worst case room for the slab header, the alignment padding and one slot. */
+		const uint32_t MIN_SLAB_SIZE = sizeof(Slab) + SLOT_ALIGNMENT + SLOT_SIZE;
+
+		for (uint32_t size_slab = SLAB_SIZE > MIN_SLAB_SIZE ? SLAB_SIZE : MIN_SLAB_SIZE; ; size_slab /= 2) {
+			if (size_slab < MIN_SLAB_SIZE) {
+				size_slab = MIN_SLAB_SIZE;
+			}
+
+			Slab* p_slab = (Slab*)p_pool->Alloc(size_slab);
+			if (p_slab != nullptr) {
+				p_slab->p_next_slab = p_slabs;
+				p_slabs = p_slab;
+
+				p_bump = align_up((uint8_t*)p_slab + sizeof(Slab));
+				p_bump_end = (uint8_t*)p_slab + size_slab;
+				return true;
+			}
+
+			if (size_slab == MIN_SLAB_SIZE)
+				return false;
+		}
+	}
+
+public:
+	explicit SlabPool(Pool& pool) : p_pool(&pool),
+									p_free_objects(nullptr),
+									p_slabs(nullptr),
+									p_bump(nullptr),
+									p_bump_end(nullptr) {}
+
+	~SlabPool() {
+		while (p_slabs != nullptr) {
+			Slab* p_slab = p_slabs;
+			p_slabs = p_slab->p_next_slab;
+			p_pool->Free(p_slab);
+		}
+	}
+
+	void* Alloc() {
+		if (p_free_objects != nullptr) {
+			FreeObject* p_object = p_free_objects;
+			p_free_objects = p_object->p_next;
+			return p_object;
+		}
+
+		if (p_bump_end - p_bump < (ptrdiff_t)SLOT_SIZE && !add_slab())
+			return nullptr;
+
+		void* p_return = p_bump;
+		p_bump += SLOT_SIZE;
+		return p_return;
+	}
+
+	void Free(void* p) {
+		if (p == nullptr)
+			return;
+
+		FreeObject* p_object = (FreeObject*)p;
+		p_object->p_next = p_free_objects;
+		p_free_objects = p_object;
+	}
+};
+
+/* Pools that can be shared between threads say so with a THREAD_SAFE member.
+A SlabPool is not, so allocators only put one in front of a pool that is not
+shared either. */
+template<class Pool, class = void>
+struct is_thread_safe_pool : std::false_type {};
+
+template<class Pool>
+struct is_thread_safe_pool<Pool, std::enable_if_t<Pool::THREAD_SAFE>> : std::true_type {};
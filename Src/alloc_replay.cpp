@@ -0,0 +1,287 @@
+#include "allocation_trace.h"
+#include "hash_table.h"
+#include "mapped_memory_pool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Replays an allocation trace recorded with AllocationTrace against malloc
+and against MappedMemoryPool configurations, one pool size per argument:
+
+    alloc_replay.out TRACE [POOL_SIZE ...]
+
+Pool sizes may end in K, M or G. Without any, pools of two and four times the
+peak of live bytes in the trace are tried. Events of all threads are replayed
+by one thread in the order they were recorded. */
+
+/* One step of the replay. Addresses are turned into slot indexes up front,
+so that no allocator pays for the lookup. */
+struct ReplayOp{
+    uint32_t size;
+    uint32_t slot;
+    uint32_t alignment;
+    bool     is_alloc;
+    uint64_t timestamp;
+};
+
+struct Trace{
+    vector<ReplayOp> ops;
+    uint32_t num_slots = 0;
+    uint32_t num_threads = 0;
+    uint64_t peak_live_bytes = 0;
+    uint64_t duration = 0;
+    /* Requests that failed when recorded and frees of blocks allocated
+    before recording started; both are left out of the replay. */
+    uint32_t num_failed_recorded = 0;
+    uint32_t num_unmatched_frees = 0;
+};
+
+struct ReplayResult{
+    double   seconds = 0;
+    uint64_t peak_bytes = 0;
+    uint32_t num_failed = 0;
+    /* Index of the first failed op, its time in the trace and the bytes live
+    at that point. */
+    uint32_t first_failure = 0;
+    uint64_t first_failure_timestamp = 0;
+    uint64_t first_failure_live_bytes = 0;
+};
+
+Trace BuildTrace(const vector<AllocationTraceEvent>& events){
+    Trace trace;
+    HashMap<uint64_t, uint32_t> live_slots;
+    vector<uint32_t> slot_sizes;
+    uint64_t live_bytes = 0;
+
+    trace.ops.reserve(events.size());
+    for(const AllocationTraceEvent& event : events){
+        if(event.thread + 1u > trace.num_threads){
+            trace.num_threads = event.thread + 1u;
+        }
+        trace.duration = event.timestamp;
+
+        if(event.kind == ALLOCATION_TRACE_ALLOC){
+            if(event.address == 0){
+                trace.num_failed_recorded++;
+                continue;
+            }
+
+            uint32_t slot = trace.num_slots++;
+            live_slots[event.address] = slot;
+            slot_sizes.push_back(event.size);
+            trace.ops.push_back({event.size, slot, 1u << event.log2_alignment, true, event.timestamp});
+
+            live_bytes += event.size;
+            if(live_bytes > trace.peak_live_bytes){
+                trace.peak_live_bytes = live_bytes;
+            }
+        }
+        else{
+            auto it = live_slots.Search(event.address);
+            if(it == live_slots.end()){
+                trace.num_unmatched_frees++;
+                continue;
+            }
+
+            uint32_t slot = it->second;
+            live_slots.Erase(it);
+            live_bytes -= slot_sizes[slot];
+            trace.ops.push_back({0, slot, 0, false, event.timestamp});
+        }
+    }
+
+    return trace;
+}
+
+/* Runs the trace through alloc(size, alignment) and free(p). sample() is
+called every SAMPLE_OPS ops and at the end and returns the footprint so far;
+the calls are part of the timed loop, so they must be cheap. What it returns
+before the first op, e.g. the memory of the replay itself, is not counted. */
+template<class Alloc, class Free, class Sample>
+ReplayResult Replay(const Trace& trace, Alloc alloc, Free free, Sample sample){
+    const uint32_t SAMPLE_OPS = 4096;
+
+    ReplayResult result;
+    vector<void*> slots(trace.num_slots, nullptr);
+    vector<uint32_t> slot_sizes(trace.num_slots, 0);
+    uint64_t live_bytes = 0;
+    uint64_t baseline = sample();
+    auto footprint_since = [&sample, baseline](){
+        uint64_t footprint = sample();
+        return footprint > baseline ? footprint - baseline : 0;
+    };
+
+    auto start = chrono::steady_clock::now();
+    for(uint32_t i = 0;i < trace.ops.size();i++){
+        const ReplayOp& op = trace.ops[i];
+        if(op.is_alloc){
+            void* p = alloc(op.size, op.alignment);
+            slots[op.slot] = p;
+            if(p == nullptr){
+                if(result.num_failed++ == 0){
+                    result.first_failure = i;
+                    result.first_failure_timestamp = op.timestamp;
+                    result.first_failure_live_bytes = live_bytes;
+                }
+            }
+            else{
+                slot_sizes[op.slot] = op.size;
+                live_bytes += op.size;
+            }
+        }
+        else if(slots[op.slot] != nullptr){
+            free(slots[op.slot]);
+            slots[op.slot] = nullptr;
+            live_bytes -= slot_sizes[op.slot];
+        }
+
+        if(i % SAMPLE_OPS == 0){
+            uint64_t footprint = footprint_since();
+            if(footprint > result.peak_bytes){
+                result.peak_bytes = footprint;
+            }
+        }
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    uint64_t footprint = footprint_since();
+    if(footprint > result.peak_bytes){
+        result.peak_bytes = footprint;
+    }
+
+    for(void* p : slots){
+        if(p != nullptr){
+            free(p);
+        }
+    }
+    return result;
+}
+
+/* The footprint of malloc is what glibc reports in use, so it includes its
+own headers like the pool figures do. Elsewhere it is not known and read 0. */
+ReplayResult ReplayMalloc(const Trace& trace){
+    return Replay(trace,
+        [](uint32_t size, uint32_t alignment) -> void*{
+            if(alignment <= alignof(max_align_t)){
+                return malloc(size);
+            }
+            return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        },
+        [](void* p){
+            free(p);
+        },
+        [](){
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+            struct mallinfo2 info = mallinfo2();
+            return (uint64_t)(info.uordblks + info.hblkhd);
+#else
+            return (uint64_t)0;
+#endif
+        });
+}
+
+template<uint32_t SIZE_CLASS_LIMIT>
+ReplayResult ReplayArena(const Trace& trace, uint32_t size_pool){
+    MappedMemoryPool<SIZE_CLASS_LIMIT, true> arena(size_pool);
+
+    ReplayResult result = Replay(trace,
+        [&arena](uint32_t size, uint32_t alignment){
+            return arena.AllocAligned(size, alignment);
+        },
+        [&arena](void* p){
+            arena.Free(p);
+        },
+        [](){
+            return (uint64_t)0;
+        });
+
+    /* The arena keeps its own high-water mark, exact and free of sampling. */
+    result.peak_bytes = arena.GetStats().peak_used_bytes;
+    return result;
+}
+
+void PrintResult(const char* name, uint64_t size_pool, const Trace& trace, const ReplayResult& result){
+    printf("%-24s %12llu %10.1f %12llu %10u",
+           name,
+           (unsigned long long)size_pool,
+           result.seconds * 1e9 / (trace.ops.empty() ? 1 : trace.ops.size()),
+           (unsigned long long)result.peak_bytes,
+           result.num_failed);
+
+    if(result.num_failed != 0){
+        printf("  op %u at %.3f ms with %llu bytes live",
+               result.first_failure,
+               result.first_failure_timestamp / 1e6,
+               (unsigned long long)result.first_failure_live_bytes);
+    }
+    printf("\n");
+}
+
+/* "64M" and the like. Returns 0 for anything that is not a size. */
+uint64_t ParseSize(const char* arg){
+    char* p_end;
+    uint64_t size = strtoull(arg, &p_end, 10);
+    switch(*p_end){
+    case 'K': case 'k': size <<= 10; p_end++; break;
+    case 'M': case 'm': size <<= 20; p_end++; break;
+    case 'G': case 'g': size <<= 30; p_end++; break;
+    }
+    return *p_end == '\0' ? size : 0;
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s TRACE [POOL_SIZE ...]\n", argv[0]);
+        return 2;
+    }
+
+    vector<AllocationTraceEvent> events;
+    if(!ReadAllocationTrace(argv[1], events)){
+        fprintf(stderr, "%s: cannot read trace %s\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    Trace trace = BuildTrace(events);
+    printf("%zu events from %u threads over %.3f ms, %llu bytes live at peak\n",
+           events.size(), trace.num_threads, trace.duration / 1e6, (unsigned long long)trace.peak_live_bytes);
+    if(trace.num_failed_recorded != 0 || trace.num_unmatched_frees != 0){
+        printf("skipped %u allocations that failed when recorded and %u frees of earlier blocks\n",
+               trace.num_failed_recorded, trace.num_unmatched_frees);
+    }
+
+    /* MemoryArena needs a region below 2 GB that holds at least its two
+    block headers. */
+    const uint64_t MAX_POOL = (1ull << 31) - 64;
+    const uint64_t MIN_POOL = 64;
+
+    vector<uint64_t> pool_sizes;
+    for(int i = 2;i < argc;i++){
+        uint64_t size = ParseSize(argv[i]);
+        if(size < MIN_POOL || size > MAX_POOL){
+            fprintf(stderr, "%s: pool size %s is not between %llu and %llu\n",
+                    argv[0], argv[i], (unsigned long long)MIN_POOL, (unsigned long long)MAX_POOL);
+            return 2;
+        }
+        pool_sizes.push_back(size);
+    }
+    if(pool_sizes.empty()){
+        for(uint64_t factor : {2, 4}){
+            uint64_t size = trace.peak_live_bytes * factor;
+            pool_sizes.push_back(size < MIN_POOL ? MIN_POOL : size > MAX_POOL ? MAX_POOL : size);
+        }
+    }
+
+    printf("%-24s %12s %10s %12s %10s\n", "allocator", "pool size", "ns/op", "peak bytes", "failures");
+    PrintResult("malloc", 0, trace, ReplayMalloc(trace));
+    for(uint64_t size_pool : pool_sizes){
+        PrintResult("MemoryPool", size_pool, trace, ReplayArena<0>(trace, (uint32_t)size_pool));
+        PrintResult("MemoryPool size classes", size_pool, trace, ReplayArena<256>(trace, (uint32_t)size_pool));
+    }
+
+    return 0;
+}
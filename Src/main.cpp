@@ -17,7 +17,9 @@ uint32_t Factorial(uint32_t val){
 
 int main(){
     map<int, int> standart_dict;
-    map<int, int, less<int>, CustomAllocator<pair<int, int>, 10 * sizeof(pair<int, int>)>> custom_dict;
+    /* The map allocates its nodes through the rebound allocator, which shares
+    the reserve size, so leave room for the tree links and block headers. */
+    map<int, int, less<int>, CustomAllocator<pair<int, int>, 10 * 64>> custom_dict;
     for(int i = 0;i < 10;i++){
         standart_dict[i] = Factorial(i);
         custom_dict[i] = Factorial(i);
@@ -27,9 +29,19 @@ int main(){
         cout << "Standart dict " << i << " " << standart_dict[i] << endl;
         cout << "Custom dict " << i << " " << custom_dict[i] << endl; 
     }
+
+    /* One pool for the whole map, handed to it through a stateful allocator. */
+    using DictPool = MemoryPool<10 * 64>;
+    DictPool dict_pool;
+    map<int, int, less<int>, PoolAllocator<pair<const int, int>, DictPool>> pool_dict{PoolAllocator<pair<const int, int>, DictPool>(dict_pool)};
+    for(int i = 0;i < 10;i++){
+        pool_dict[i] = Factorial(i);
+    }
+
+    cout << "Pool dict free bytes " << dict_pool.GetFreeBytes() << endl;
  
     HashTable<int> standart_hash;
-    HashTable<int, std::hash<int>, CustomAllocator<int, sizeof(int) * 10 * 2>> custom_hash;
+    HashTable<int, std::hash<int>, CustomAllocator<int, 1024>> custom_hash;
     for(int i = 0;i < 10;i++){
         standart_hash.Insert(Factorial(i));
         custom_hash.Insert(Factorial(i));           
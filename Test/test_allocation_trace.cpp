@@ -0,0 +1,127 @@
+#include "allocation_trace.h"
+#include "custom_allocator.h"
+#include "memory_pool.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+TEST(AllocationTrace, TestRecordAndRead){
+    const char* PATH = "test_allocation_trace.bin";
+    TracedPool<MemoryPool<4096>> pool;
+    AllocationTrace trace;
+    ASSERT_TRUE(trace.Open(PATH));
+
+    /* Nothing is logged before the trace is set. */
+    pool.Free(pool.Alloc(16));
+    pool.SetTrace(&trace);
+
+    void* p_small = pool.Alloc(24);
+    void* p_aligned = pool.AllocAligned(100, 64);
+    ASSERT_EQ(pool.Alloc(8192), nullptr);
+    pool.Free(p_small);
+    pool.Free(p_aligned);
+    ASSERT_TRUE(trace.Close());
+    ASSERT_FALSE(trace.IsOpen());
+
+    vector<AllocationTraceEvent> events;
+    ASSERT_TRUE(ReadAllocationTrace(PATH, events));
+    ASSERT_EQ(events.size(), 5);
+
+    ASSERT_EQ(events[0].kind, ALLOCATION_TRACE_ALLOC);
+    ASSERT_EQ(events[0].address, (uint64_t)(uintptr_t)p_small);
+    ASSERT_EQ(events[0].size, 24);
+    ASSERT_EQ(events[1].size, 100);
+    ASSERT_EQ(events[1].log2_alignment, 6);
+    ASSERT_EQ(events[2].address, 0);
+    ASSERT_EQ(events[3].kind, ALLOCATION_TRACE_FREE);
+    ASSERT_EQ(events[3].address, (uint64_t)(uintptr_t)p_small);
+    ASSERT_EQ(events[4].address, (uint64_t)(uintptr_t)p_aligned);
+    for(uint32_t i = 1;i < events.size();i++){
+        ASSERT_GE(events[i].timestamp, events[i - 1].timestamp);
+    }
+
+    remove(PATH);
+}
+
+TEST(AllocationTrace, TestThreads){
+    const char* PATH = "test_allocation_trace_threads.bin";
+    const int NUM_THREADS = 4;
+    const int NUM_ALLOCS = 10000;
+
+    TracedPool<MemoryPool<1 << 16>> pool;
+    mutex pool_mutex;
+    AllocationTrace trace;
+    ASSERT_TRUE(trace.Open(PATH));
+    pool.SetTrace(&trace);
+
+    vector<thread> threads;
+    for(int t = 0;t < NUM_THREADS;t++){
+        threads.emplace_back([&](){
+            for(int i = 0;i < NUM_ALLOCS;i++){
+                lock_guard<mutex> lock(pool_mutex);
+                pool.Free(pool.Alloc(32));
+            }
+        });
+    }
+    for(thread& t : threads){
+        t.join();
+    }
+    ASSERT_TRUE(trace.Close());
+
+    vector<AllocationTraceEvent> events;
+    ASSERT_TRUE(ReadAllocationTrace(PATH, events));
+    ASSERT_EQ(events.size(), 2 * NUM_THREADS * NUM_ALLOCS);
+
+    vector<int> per_thread(65536, 0);
+    for(const AllocationTraceEvent& event : events){
+        per_thread[event.thread]++;
+    }
+    int num_threads = 0;
+    for(int count : per_thread){
+        if(count != 0){
+            ASSERT_EQ(count, 2 * NUM_ALLOCS);
+            num_threads++;
+        }
+    }
+    ASSERT_EQ(num_threads, NUM_THREADS);
+
+    remove(PATH);
+}
+
+TEST(AllocationTrace, TestCustomAllocator){
+    const char* PATH = "test_allocation_trace_custom.bin";
+    using Allocator = CustomAllocator<int, 1 << 16, TracedPool<MemoryPool<1 << 16>>>;
+    AllocationTrace trace;
+    ASSERT_TRUE(trace.Open(PATH));
+    Allocator::GetPool().SetTrace(&trace);
+    {
+        vector<int, Allocator> ints;
+        for(int i = 0;i < 1000;i++){
+            ints.push_back(i);
+        }
+    }
+    Allocator::GetPool().SetTrace(nullptr);
+    ASSERT_TRUE(trace.Close());
+
+    vector<AllocationTraceEvent> events;
+    ASSERT_TRUE(ReadAllocationTrace(PATH, events));
+    ASSERT_FALSE(events.empty());
+
+    /* The first, single int came from a slab, which stays with the
+    allocator; every array after it was given back. */
+    int live = 0;
+    for(const AllocationTraceEvent& event : events){
+        live += event.kind == ALLOCATION_TRACE_ALLOC ? 1 : -1;
+    }
+    ASSERT_EQ(live, 1);
+
+    remove(PATH);
+}
+
+TEST(AllocationTrace, TestNotATrace){
+    vector<AllocationTraceEvent> events;
+    ASSERT_FALSE(ReadAllocationTrace("no_such_trace.bin", events));
+}
@@ -0,0 +1,95 @@
+#include "chunked_memory_pool.h"
+#include "custom_allocator.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+TEST(ChunkedMemoryPool, GrowAndShrink){
+    ChunkedMemoryPool<1 << 16> mem_pool;
+    ASSERT_EQ(mem_pool.GetNumChunks(), 0);
+
+    vector<void*> blocks;
+    for(int i = 0;i < 256;i++){
+        void* p = mem_pool.Alloc(1024);
+        ASSERT_NE(p, nullptr);
+        memset(p, i, 1024);
+        blocks.push_back(p);
+    }
+    ASSERT_GT(mem_pool.GetNumChunks(), 3);
+
+    for(size_t i = 0;i < blocks.size();i++){
+        ASSERT_EQ(((uint8_t*)blocks[i])[1023], (uint8_t)i);
+        mem_pool.Free(blocks[i]);
+    }
+
+    /* Only the spare chunk stays mapped. */
+    ASSERT_EQ(mem_pool.GetNumChunks(), 1);
+}
+
+TEST(ChunkedMemoryPool, Cap){
+    ChunkedMemoryPool<1 << 16, 2> mem_pool;
+
+    vector<void*> blocks;
+    for(void* p = mem_pool.Alloc(4096); p != nullptr; p = mem_pool.Alloc(4096)){
+        blocks.push_back(p);
+    }
+    ASSERT_EQ(mem_pool.GetNumChunks(), 2);
+    ASSERT_GT(blocks.size(), 16);
+
+    mem_pool.Free(blocks.back());
+    blocks.pop_back();
+    ASSERT_NE(mem_pool.Alloc(4096), nullptr);
+}
+
+TEST(ChunkedMemoryPool, LargeRequest){
+    ChunkedMemoryPool<1 << 16> mem_pool;
+
+    void* p_small = mem_pool.Alloc(64);
+    ASSERT_NE(p_small, nullptr);
+
+    void* p_large = mem_pool.Alloc(300000);
+    ASSERT_NE(p_large, nullptr);
+    ASSERT_GE(ChunkedMemoryPool<1 << 16>::GetBlockSize(p_large), 300000);
+    memset(p_large, 0xAA, 300000);
+    ASSERT_EQ(mem_pool.GetNumChunks(), 2);
+
+    /* A dedicated chunk is unmapped as soon as its block is freed. */
+    mem_pool.Free(p_large);
+    ASSERT_EQ(mem_pool.GetNumChunks(), 1);
+    mem_pool.Free(p_small);
+}
+
+TEST(ChunkedMemoryPool, Realloc){
+    ChunkedMemoryPool<1 << 16> mem_pool;
+
+    /* Grows in place while the chunk has room, then moves to a dedicated
+    chunk, keeping the contents. */
+    uint32_t size = 64;
+    uint8_t* p = (uint8_t*)mem_pool.Alloc(size);
+    memset(p, 0x5A, size);
+    for(; size < 200000; size *= 2){
+        p = (uint8_t*)mem_pool.Realloc(p, size * 2);
+        ASSERT_NE(p, nullptr);
+        ASSERT_EQ(p[size - 1], 0x5A);
+        memset(p, 0x5A, size * 2);
+    }
+    ASSERT_EQ(mem_pool.GetNumChunks(), 2);
+
+    mem_pool.Free(p);
+    ASSERT_EQ(mem_pool.GetNumChunks(), 1);
+}
+
+TEST(ChunkedMemoryPool, CustomAllocator){
+    vector<int, CustomAllocator<int, 0, ChunkedMemoryPool<1 << 16>>> values;
+    for(int i = 0;i < 100000;i++){
+        values.push_back(i);
+    }
+
+    long sum = 0;
+    for(int v : values){
+        sum += v;
+    }
+    ASSERT_EQ(sum, 99999L * 100000 / 2);
+}
@@ -0,0 +1,169 @@
+#include "concurrent_hash_table.h"
+#include "custom_allocator.h"
+#include "concurrent_memory_pool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+TEST(ConcurrentHashTable, TestSingleThread){
+    ConcurrentHashTable<string> h_strings;
+    ASSERT_TRUE(h_strings.Insert("A"));
+    ASSERT_TRUE(h_strings.Insert("B"));
+    ASSERT_FALSE(h_strings.Insert("A"));
+    ASSERT_EQ(h_strings.Size(), 2);
+
+    ASSERT_TRUE(h_strings.Contains("A"));
+    ASSERT_FALSE(h_strings.Contains("C"));
+
+    ASSERT_TRUE(h_strings.Erase("A"));
+    ASSERT_FALSE(h_strings.Erase("A"));
+    ASSERT_FALSE(h_strings.Contains("A"));
+    ASSERT_EQ(h_strings.Size(), 1);
+
+    h_strings.Clear();
+    ASSERT_EQ(h_strings.Size(), 0);
+}
+
+TEST(ConcurrentHashTable, TestParallelInsert){
+    const int NUM_THREADS = 8;
+    const int NUM_VALUES = 20000;
+    ConcurrentHashTable<int> h_ints;
+    h_ints.Reserve(NUM_VALUES);
+
+    /* Every value is inserted by two threads, only one of them succeeds. */
+    atomic<int> num_inserted(0);
+    vector<thread> threads;
+    for(int t = 0;t < NUM_THREADS;t++){
+        threads.emplace_back([&, t](){
+            for(int i = t / 2;i < NUM_VALUES;i += NUM_THREADS / 2){
+                if(h_ints.Insert(int(i))){
+                    num_inserted++;
+                }
+            }
+        });
+    }
+    for(auto& th : threads){
+        th.join();
+    }
+
+    ASSERT_EQ(num_inserted, NUM_VALUES);
+    ASSERT_EQ(h_ints.Size(), NUM_VALUES);
+
+    vector<bool> seen(NUM_VALUES, false);
+    h_ints.ForEach([&](int value){
+        ASSERT_FALSE(seen[value]);
+        seen[value] = true;
+    });
+    for(int i = 0;i < NUM_VALUES;i++){
+        ASSERT_TRUE(seen[i]);
+    }
+}
+
+TEST(ConcurrentHashTable, TestReadersAndWriters){
+    const int NUM_READERS = 4;
+    const int NUM_VALUES = 2000;
+    ConcurrentHashTable<int> h_ints;
+
+    /* Even values stay in the table the whole time, odd ones come and go. */
+    for(int i = 0;i < NUM_VALUES;i += 2){
+        h_ints.Insert(int(i));
+    }
+
+    atomic<bool> stop(false);
+    atomic<int> errors(0);
+    vector<thread> readers;
+    for(int t = 0;t < NUM_READERS;t++){
+        readers.emplace_back([&](){
+            while(!stop){
+                for(int i = 0;i < NUM_VALUES;i += 2){
+                    if(!h_ints.Contains(i)){
+                        errors++;
+                    }
+                }
+                this_thread::yield();
+            }
+        });
+    }
+
+    for(int round = 0;round < 3;round++){
+        for(int i = 1;i < NUM_VALUES;i += 2){
+            h_ints.Insert(int(i));
+        }
+        for(int i = 1;i < NUM_VALUES;i += 2){
+            h_ints.Erase(i);
+        }
+    }
+    stop = true;
+    for(auto& th : readers){
+        th.join();
+    }
+
+    ASSERT_EQ(errors, 0);
+    ASSERT_EQ(h_ints.Size(), NUM_VALUES / 2);
+}
+
+TEST(ConcurrentHashTable, TestPoolPerShard){
+    const uint32_t SHARD_COUNT = 4;
+    using Pool = MemoryPool<1 << 18>;
+    using Alloc = PoolAllocator<int, Pool>;
+
+    vector<unique_ptr<Pool>> pools;
+    for(uint32_t i = 0;i < SHARD_COUNT;i++){
+        pools.push_back(make_unique<Pool>());
+    }
+    const uint32_t FREE_BYTES = pools[0]->GetFreeBytes();
+
+    {
+        ConcurrentHashTable<int, hash<int>, Alloc, SHARD_COUNT> h_ints([&](uint32_t idx){
+            return Alloc(*pools[idx]);
+        });
+
+        vector<thread> threads;
+        for(int t = 0;t < 4;t++){
+            threads.emplace_back([&, t](){
+                for(int i = t;i < 4000;i += 4){
+                    h_ints.Insert(int(i));
+                }
+            });
+        }
+        for(auto& th : threads){
+            th.join();
+        }
+        ASSERT_EQ(h_ints.Size(), 4000);
+
+        /* The values are spread, so every shard draws from its own pool. */
+        for(auto& p_pool : pools){
+            ASSERT_LT(p_pool->GetFreeBytes(), FREE_BYTES);
+        }
+    }
+
+    for(auto& p_pool : pools){
+        ASSERT_EQ(p_pool->GetFreeBytes(), FREE_BYTES);
+    }
+}
+
+TEST(ConcurrentHashTable, TestSharedCustomAllocator){
+    ConcurrentHashTable<int, hash<int>, CustomAllocator<int, 1 << 20, ConcurrentMemoryPool<1 << 20>>> h_ints;
+
+    vector<thread> threads;
+    for(int t = 0;t < 4;t++){
+        threads.emplace_back([&, t](){
+            for(int i = t;i < 4000;i += 4){
+                h_ints.Insert(int(i));
+            }
+        });
+    }
+    for(auto& th : threads){
+        th.join();
+    }
+
+    ASSERT_EQ(h_ints.Size(), 4000);
+    for(int i = 0;i < 4000;i++){
+        ASSERT_TRUE(h_ints.Contains(i));
+    }
+}
@@ -0,0 +1,134 @@
+#include "concurrent_memory_pool.h"
+#include "custom_allocator.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+TEST(ConcurrentMemoryPool, ReuseInThread){
+    auto p_pool = make_unique<ConcurrentMemoryPool<4096>>();
+
+    void* p = p_pool->Alloc(24);
+    ASSERT_NE(p, nullptr);
+    p_pool->Free(p);
+    ASSERT_EQ(p_pool->Alloc(24), p);
+
+    void* p_large = p_pool->Alloc(1024);
+    ASSERT_NE(p_large, nullptr);
+    p_pool->Free(p_large);
+}
+
+TEST(ConcurrentMemoryPool, FreeFromOtherThread){
+    auto p_pool = make_unique<ConcurrentMemoryPool<1 << 16>>();
+    const uint32_t FREE_BYTES = p_pool->GetFreeBytes();
+
+    vector<void*> blocks;
+    thread producer([&](){
+        for(int i = 0;i < 100;i++){
+            blocks.push_back(p_pool->Alloc(16 + i % 64));
+        }
+    });
+    producer.join();
+
+    thread consumer([&](){
+        for(void* p : blocks){
+            ASSERT_NE(p, nullptr);
+            p_pool->Free(p);
+        }
+    });
+    consumer.join();
+
+    /* Both threads have exited, so their caches went back to the pool. */
+    void* p = p_pool->Alloc(FREE_BYTES / 2);
+    ASSERT_NE(p, nullptr);
+    p_pool->Free(p);
+}
+
+TEST(ConcurrentMemoryPool, Stress){
+    const int NUM_THREADS = 8;
+    const int NUM_ITERATIONS = 20000;
+    const uint32_t SIZE_POOL = 1 << 22;
+    auto p_pool = make_unique<ConcurrentMemoryPool<SIZE_POOL>>();
+
+    vector<thread> threads;
+    vector<int> errors(NUM_THREADS, 0);
+    for(int t = 0;t < NUM_THREADS;t++){
+        threads.emplace_back([&, t](){
+            mt19937 gen(t);
+            uniform_int_distribution<uint32_t> size_dist(1, 400);
+            vector<pair<uint8_t*, uint32_t>> live;
+
+            for(int i = 0;i < NUM_ITERATIONS;i++){
+                if(live.size() < 64 && (live.empty() || gen() % 2 == 0)){
+                    uint32_t size = size_dist(gen);
+                    uint8_t* p = (uint8_t*)p_pool->Alloc(size);
+                    if(p == nullptr){
+                        errors[t]++;
+                        continue;
+                    }
+                    memset(p, t + 1, size);
+                    live.emplace_back(p, size);
+                }else{
+                    size_t idx = gen() % live.size();
+                    auto block = live[idx];
+                    for(uint32_t j = 0;j < block.second;j++){
+                        if(block.first[j] != t + 1){
+                            errors[t]++;
+                            break;
+                        }
+                    }
+                    p_pool->Free(block.first);
+                    live[idx] = live.back();
+                    live.pop_back();
+                }
+            }
+
+            for(auto block : live){
+                p_pool->Free(block.first);
+            }
+        });
+    }
+
+    for(auto& th : threads){
+        th.join();
+    }
+
+    for(int t = 0;t < NUM_THREADS;t++){
+        ASSERT_EQ(errors[t], 0);
+    }
+
+    void* p = p_pool->Alloc(SIZE_POOL / 2);
+    ASSERT_NE(p, nullptr);
+    p_pool->Free(p);
+}
+
+TEST(ConcurrentMemoryPool, CustomAllocatorInThreads){
+    using Alloc = CustomAllocator<int, 1 << 20, ConcurrentMemoryPool<1 << 20>>;
+
+    vector<thread> threads;
+    vector<long> sums(4, 0);
+    for(int t = 0;t < 4;t++){
+        threads.emplace_back([&, t](){
+            list<int, Alloc> values;
+            for(int i = 0;i < 1000;i++){
+                values.push_back(i);
+            }
+            for(int v : values){
+                sums[t] += v;
+            }
+        });
+    }
+
+    for(auto& th : threads){
+        th.join();
+    }
+
+    for(long sum : sums){
+        ASSERT_EQ(sum, 999 * 1000 / 2);
+    }
+}
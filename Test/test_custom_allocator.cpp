@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include "custom_allocator.h"
+#include "hash_table.h"
+#include <list>
+#include <map>
 #include <vector>
 
 using namespace std;
@@ -36,4 +39,107 @@ TEST(custom_allocator, test_count_constructions){
     test_vec.clear();
     ASSERT_EQ(Counter::GetCounter(), 0);   
 
-}
\ No newline at end of file
+}
+
+TEST(custom_allocator, test_exhausted_pool_throws){
+    vector<int, CustomAllocator<int, 256>> test_vec;
+    ASSERT_THROW(test_vec.reserve(1024), std::bad_alloc);
+    ASSERT_EQ(test_vec.capacity(), 0);
+}
+
+TEST(custom_allocator, test_pool_stats){
+    using Allocator = CustomAllocator<int, 4096, MemoryPool<4096, CUSTOM_ALLOCATOR_SIZE_CLASS_LIMIT, true>>;
+    vector<int, Allocator> test_vec;
+    test_vec.reserve(100);
+    ASSERT_THROW(test_vec.reserve(2048), std::bad_alloc);
+
+    MemoryPoolStats stats = Allocator::GetPool().GetStats();
+    ASSERT_EQ(stats.alloc_count, 1);
+    ASSERT_EQ(stats.failed_allocs, 1);
+    ASSERT_GE(stats.peak_used_bytes, 400);
+}
+
+
+TEST(pool_allocator, test_shared_pool){
+    using Pool = MemoryPool<4096>;
+    using Alloc = PoolAllocator<pair<const int, int>, Pool>;
+    Pool pool;
+    const uint32_t FREE_BYTES = pool.GetFreeBytes();
+
+    {
+        map<int, int, less<int>, Alloc> dict{Alloc(pool)};
+        for(int i = 0;i < 10;i++){
+            dict[i] = i;
+        }
+
+        /* The tree nodes come from the one pool handed to the map. */
+        ASSERT_LT(pool.GetFreeBytes(), FREE_BYTES);
+        ASSERT_EQ(&dict.get_allocator().GetPool(), &pool);
+
+        PoolAllocator<int, Pool> rebound(dict.get_allocator());
+        ASSERT_TRUE(rebound == dict.get_allocator());
+    }
+
+    ASSERT_EQ(pool.GetFreeBytes(), FREE_BYTES);
+}
+
+TEST(pool_allocator, test_propagation){
+    using Pool = MemoryPool<4096>;
+    using Alloc = PoolAllocator<int, Pool>;
+    Pool lhs_pool;
+    Pool rhs_pool;
+
+    list<int, Alloc> lhs{Alloc(lhs_pool)};
+    list<int, Alloc> rhs{Alloc(rhs_pool)};
+    lhs.push_back(1);
+    rhs.push_back(2);
+    ASSERT_TRUE(lhs.get_allocator() != rhs.get_allocator());
+
+    lhs.swap(rhs);
+    ASSERT_EQ(&lhs.get_allocator().GetPool(), &rhs_pool);
+    ASSERT_EQ(&rhs.get_allocator().GetPool(), &lhs_pool);
+    ASSERT_EQ(lhs.front(), 2);
+
+    list<int, Alloc> copy{Alloc(lhs_pool)};
+    copy = lhs;
+    ASSERT_EQ(&copy.get_allocator().GetPool(), &rhs_pool);
+
+    list<int, Alloc> moved{Alloc(lhs_pool)};
+    moved = std::move(rhs);
+    ASSERT_EQ(&moved.get_allocator().GetPool(), &lhs_pool);
+    ASSERT_EQ(moved.front(), 1);
+
+    list<int, Alloc> copy_constructed(copy);
+    ASSERT_EQ(&copy_constructed.get_allocator().GetPool(), &rhs_pool);
+}
+
+TEST(pool_allocator, test_hash_table){
+    using Pool = MemoryPool<4096>;
+    Pool pool;
+    const uint32_t FREE_BYTES = pool.GetFreeBytes();
+
+    {
+        HashTable<int, hash<int>, PoolAllocator<int, Pool>> table{PoolAllocator<int, Pool>(pool)};
+        for(int i = 0;i < 50;i++){
+            table.Insert(int(i));
+        }
+        ASSERT_EQ(table.Size(), 50);
+        ASSERT_LT(pool.GetFreeBytes(), FREE_BYTES);
+    }
+
+    ASSERT_EQ(pool.GetFreeBytes(), FREE_BYTES);
+}
+
+struct alignas(64) CacheLine{
+    uint8_t bytes[64];
+};
+
+TEST(custom_allocator, test_over_aligned_type){
+    vector<CacheLine, CustomAllocator<CacheLine>> test_vec(7);
+    ASSERT_EQ((uintptr_t)test_vec.data() % 64, 0);
+
+    list<CacheLine, CustomAllocator<CacheLine>> test_list(3);
+    for(const CacheLine& line : test_list){
+        ASSERT_EQ((uintptr_t)&line % 64, 0);
+    }
+}
@@ -0,0 +1,113 @@
+#include "flat_hash_table.h"
+#include "custom_allocator.h"
+#include <string>
+#include <gtest/gtest.h>
+#include <set>
+
+using namespace std;
+
+TEST(FlatHashTable, TestIterate){
+    FlatHashTable<string> h_strings;
+    ASSERT_EQ(h_strings.Size(), 0);
+    ASSERT_EQ(h_strings.begin(), h_strings.end());
+
+    h_strings.Insert("A");
+    h_strings.Insert("C");
+    h_strings.Insert("B");
+    ASSERT_EQ(h_strings.Size(), 3);
+
+    set<string> sorted_strings;
+    for(auto it = h_strings.begin(); it != h_strings.end(); it++){
+        sorted_strings.insert(*it);
+    }
+    ASSERT_EQ(sorted_strings, set<string>({"A", "B", "C"}));
+
+    sorted_strings.clear();
+    auto it = h_strings.end();
+    sorted_strings.insert(*(--it));
+    sorted_strings.insert(*(--it));
+    sorted_strings.insert(*(--it));
+    ASSERT_EQ(it, h_strings.begin());
+    ASSERT_EQ(sorted_strings, set<string>({"A", "B", "C"}));
+}
+
+TEST(FlatHashTable, TestSearch){
+    FlatHashTable<string> h_strings;
+
+    for(int i = 0;i < 20000;i++){
+        h_strings.Insert("Six");
+    }
+
+    h_strings.Insert("One");
+    h_strings.Insert("Two");
+    h_strings.Insert("Three");
+    h_strings.Insert("Four");
+    h_strings.Insert("Five");
+
+    ASSERT_EQ(h_strings.Size(), 6);
+    auto it = h_strings.Search("Five");
+    ASSERT_EQ(*it, "Five");
+
+    it = h_strings.Search("Seven");
+    ASSERT_EQ(it, h_strings.end());
+}
+
+TEST(FlatHashTable, TestManyValues){
+    FlatHashTable<int> h_ints;
+    const int NUM_VALUES = 100000;
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        auto it = h_ints.Insert(int(i));
+        ASSERT_EQ(*it, i);
+    }
+    ASSERT_EQ(h_ints.Size(), NUM_VALUES);
+    ASSERT_EQ(h_ints.Insert(int(5)), h_ints.end());
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        ASSERT_EQ(*h_ints.Search(i), i);
+    }
+    ASSERT_EQ(h_ints.Search(NUM_VALUES), h_ints.end());
+
+    long sum = 0;
+    for(int value : h_ints){
+        sum += value;
+    }
+    ASSERT_EQ(sum, (long)NUM_VALUES * (NUM_VALUES - 1) / 2);
+}
+
+TEST(FlatHashTable, TestEraseChurn){
+    FlatHashTable<int> h_ints;
+
+    /* Deleted slots must neither break lookups nor make the table grow
+    without bound. */
+    for(int i = 0;i < 1000;i++){
+        h_ints.Insert(int(i));
+    }
+    const uint32_t CAPACITY = h_ints.Capacity();
+
+    for(int i = 1000;i < 100000;i++){
+        ASSERT_TRUE(h_ints.Erase(h_ints.Search(i - 1000)));
+        auto it = h_ints.Insert(int(i));
+        ASSERT_EQ(*it, i);
+        ASSERT_EQ(h_ints.Search(i - 1000), h_ints.end());
+        ASSERT_EQ(*h_ints.Search(i - 500), i - 500);
+    }
+
+    ASSERT_EQ(h_ints.Size(), 1000);
+    ASSERT_EQ(h_ints.Capacity(), CAPACITY);
+    ASSERT_FALSE(h_ints.Erase(h_ints.Search(0)));
+
+    h_ints.Clear();
+    ASSERT_EQ(h_ints.Size(), 0);
+    ASSERT_EQ(h_ints.begin(), h_ints.end());
+}
+
+TEST(FlatHashTable, TestCustomAllocator){
+    FlatHashTable<string, hash<string>, CustomAllocator<string, 1 << 20>> h_strings;
+    for(int i = 0;i < 1000;i++){
+        h_strings.Insert(to_string(i));
+    }
+
+    ASSERT_EQ(h_strings.Size(), 1000);
+    ASSERT_EQ(*h_strings.Search("999"), "999");
+}
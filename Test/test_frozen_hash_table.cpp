@@ -0,0 +1,76 @@
+#include "frozen_hash_table.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+enum class Color{RED, GREEN, BLUE};
+
+constexpr auto COMMANDS = MakeFrozenHashTable<string_view>({"get", "set", "del", "incr", "decr", "expire", "ttl", "keys"});
+
+/* The whole layout is computed by the compiler. */
+static_assert(COMMANDS.Size() == 8);
+static_assert(COMMANDS.Contains("expire"));
+static_assert(!COMMANDS.Contains("exp"));
+static_assert(*COMMANDS.Search("ttl") == "ttl");
+
+constexpr auto COLORS = MakeFrozenHashTable<Color>({Color::RED, Color::BLUE});
+static_assert(COLORS.Contains(Color::BLUE));
+static_assert(!COLORS.Contains(Color::GREEN));
+
+TEST(FrozenHashTable, TestSearch){
+    for(string_view command : {"get", "set", "del", "incr", "decr", "expire", "ttl", "keys"}){
+        auto it = COMMANDS.Search(command);
+        ASSERT_NE(it, COMMANDS.end());
+        ASSERT_EQ(*it, command);
+    }
+
+    /* Lookups with runtime strings. */
+    string missing = "gets";
+    ASSERT_EQ(COMMANDS.Search(missing), COMMANDS.end());
+    ASSERT_EQ(COMMANDS.Search(""), COMMANDS.end());
+    string key = "incr";
+    ASSERT_TRUE(COMMANDS.Contains(key));
+}
+
+TEST(FrozenHashTable, TestIterate){
+    /* Keys are iterated in the order they were given. */
+    auto it = COMMANDS.begin();
+    ASSERT_EQ(*(it++), "get");
+    ASSERT_EQ(*(it++), "set");
+    ASSERT_EQ(*(COMMANDS.end() - 1), "keys");
+
+    uint32_t num_values = 0;
+    for(string_view command : COMMANDS){
+        ASSERT_TRUE(COMMANDS.Contains(command));
+        num_values++;
+    }
+    ASSERT_EQ(num_values, COMMANDS.Size());
+}
+
+TEST(FrozenHashTable, TestManyInts){
+    constexpr int NUM_VALUES = 1000;
+    int keys[NUM_VALUES] = {};
+    for(int i = 0;i < NUM_VALUES;i++){
+        keys[i] = i * 7919;
+    }
+
+    /* Built at runtime, the layout is the same as in a constant expression. */
+    FrozenHashTable<int, NUM_VALUES> h_ints(keys);
+    ASSERT_LT(h_ints.Capacity(), 5 * NUM_VALUES / 2);
+    for(int i = 0;i < NUM_VALUES * 7919;i++){
+        auto it = h_ints.Search(i);
+        if(i % 7919 == 0){
+            ASSERT_EQ(*it, i);
+        }else{
+            ASSERT_EQ(it, h_ints.end());
+        }
+    }
+}
+
+TEST(FrozenHashTable, TestDuplicates){
+    int keys[] = {1, 2, 1};
+    ASSERT_THROW((FrozenHashTable<int, 3>(keys)), invalid_argument);
+}
@@ -1,7 +1,10 @@
 #include "hash_table.h"
+#include "custom_allocator.h"
 #include <string>
+#include <string_view>
 #include <gtest/gtest.h>
 #include <set>
+#include <vector>
 
 using namespace std;
 
@@ -178,4 +181,440 @@ TEST(HashTable, TestErase){
 
     ASSERT_TRUE(h_strings.Erase(h_strings.begin()));
     ASSERT_EQ(h_strings.Size(), 0);
-}
\ No newline at end of file
+}
+TEST(HashTable, TestClear){
+    HashTable<string> h_strings;
+    for(int i = 0;i < 100;i++){
+        h_strings.Insert(to_string(i));
+    }
+    const uint32_t CAPACITY = h_strings.Capacity();
+
+    h_strings.Clear();
+    ASSERT_EQ(h_strings.Size(), 0);
+    ASSERT_EQ(h_strings.Capacity(), CAPACITY);
+    ASSERT_EQ(h_strings.begin(), h_strings.end());
+    ASSERT_EQ(h_strings.Search("1"), h_strings.end());
+
+    h_strings.Insert("1");
+    ASSERT_EQ(h_strings.Size(), 1);
+    ASSERT_EQ(*h_strings.Search("1"), "1");
+}
+
+template<class Table>
+void check_sequential_ints(){
+    Table h_ints;
+    const int NUM_VALUES = 50000;
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_ints.Insert(int(i));
+    }
+    ASSERT_EQ(h_ints.Size(), NUM_VALUES);
+    ASSERT_EQ(h_ints.Capacity() & (h_ints.Capacity() - 1), 0);
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        ASSERT_EQ(*h_ints.Search(i), i);
+    }
+    ASSERT_EQ(h_ints.Search(NUM_VALUES), h_ints.end());
+    ASSERT_EQ(h_ints.Search(-1), h_ints.end());
+}
+
+TEST(HashTable, TestSequentialInts){
+    check_sequential_ints<HashTable<int>>();
+    check_sequential_ints<HashTable<int, hash<int>, allocator<int>, false>>();
+}
+
+TEST(HashTable, TestMaxProbeLength){
+    HashTable<int> h_ints;
+    ASSERT_EQ(h_ints.MaxProbeLength(), 0);
+    h_ints.Insert(1);
+    ASSERT_EQ(h_ints.MaxProbeLength(), 1);
+
+    for(int i = 0;i < 50000;i++){
+        h_ints.Insert(int(i));
+    }
+    ASSERT_GE(h_ints.MaxProbeLength(), 1);
+    ASSERT_LT(h_ints.MaxProbeLength(), 64);
+}
+
+TEST(HashTable, TestStats){
+    HashTable<int, hash<int>, allocator<int>, true, false, false, true> h_ints;
+    for(int i = 0;i < 1000;i++){
+        h_ints.Insert(int(i));
+    }
+    for(int i = 0;i < 100;i++){
+        h_ints.Erase(h_ints.Search(i));
+    }
+
+    HashTableStats stats = h_ints.GetStats();
+    ASSERT_EQ(stats.size, 900);
+    ASSERT_EQ(stats.capacity, h_ints.Capacity());
+    ASSERT_EQ(stats.tombstones, 100);
+    ASSERT_GT(stats.resize_count, 1);
+    ASSERT_GT(stats.resize_nanoseconds, 0);
+    ASSERT_EQ(stats.max_probe_length, h_ints.MaxProbeLength());
+    ASSERT_GE(stats.MeanProbeLength(), 1.0);
+
+    uint64_t num_values = 0;
+    for(uint64_t count : stats.probe_lengths){
+        num_values += count;
+    }
+    ASSERT_EQ(num_values, 900);
+
+    string json = stats.ToJson();
+    ASSERT_NE(json.find("\"size\":900"), string::npos);
+    ASSERT_NE(json.find("\"tombstones\":100"), string::npos);
+
+    /* Without COLLECT_STATS only the resize figures are missing. */
+    HashTable<int> h_plain;
+    h_plain.Insert(1);
+    stats = h_plain.GetStats();
+    ASSERT_EQ(stats.size, 1);
+    ASSERT_EQ(stats.probe_lengths[0], 1);
+    ASSERT_EQ(stats.resize_count, 0);
+}
+
+struct CountingHash{
+    static int calls;
+
+    size_t operator()(const string& value) const{
+        calls++;
+        return hash<string>{}(value);
+    }
+};
+
+int CountingHash::calls = 0;
+
+TEST(HashTable, TestStoredHash){
+    HashTable<string, CountingHash, allocator<string>, true, true> h_strings;
+    const int NUM_VALUES = 1000;
+
+    /* Growing the table reuses the stored hashes. */
+    CountingHash::calls = 0;
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_strings.Insert(to_string(i));
+    }
+    ASSERT_EQ(CountingHash::calls, NUM_VALUES);
+
+    CountingHash::calls = 0;
+    for(int i = 0;i < NUM_VALUES;i++){
+        ASSERT_EQ(*h_strings.Search(to_string(i)), to_string(i));
+    }
+    ASSERT_EQ(CountingHash::calls, NUM_VALUES);
+    ASSERT_EQ(h_strings.Search("Missing"), h_strings.end());
+
+    ASSERT_TRUE(h_strings.Erase(h_strings.Search("10")));
+    ASSERT_EQ(h_strings.Search("10"), h_strings.end());
+    ASSERT_EQ(h_strings.Size(), NUM_VALUES - 1);
+}
+
+TEST(HashTable, TestReserve){
+    const int NUM_VALUES = 1000;
+
+    HashTable<int> h_ints(NUM_VALUES);
+    const uint32_t CAPACITY = h_ints.Capacity();
+    ASSERT_GE(CAPACITY, NUM_VALUES);
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_ints.Insert(int(i));
+    }
+    ASSERT_EQ(h_ints.Capacity(), CAPACITY);
+
+    HashTable<string, CountingHash> h_strings;
+    h_strings.Reserve(NUM_VALUES);
+    const uint32_t STRINGS_CAPACITY = h_strings.Capacity();
+
+    CountingHash::calls = 0;
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_strings.Insert(to_string(i));
+    }
+    ASSERT_EQ(h_strings.Capacity(), STRINGS_CAPACITY);
+    ASSERT_EQ(CountingHash::calls, NUM_VALUES);
+
+    /* Reserving less than the current capacity does nothing. */
+    h_strings.Reserve(1);
+    ASSERT_EQ(h_strings.Capacity(), STRINGS_CAPACITY);
+    ASSERT_EQ(*h_strings.Search("500"), "500");
+}
+
+TEST(HashTable, TestEraseChurn){
+    HashTable<int> h_ints;
+
+    for(int i = 0;i < 1000;i++){
+        h_ints.Insert(int(i));
+    }
+    const uint32_t CAPACITY = h_ints.Capacity();
+
+    /* Deleted cells must not end probe sequences, let a value be inserted
+    twice, or make the table grow without bound. */
+    for(int i = 1000;i < 200000;i++){
+        ASSERT_TRUE(h_ints.Erase(h_ints.Search(i - 1000)));
+        h_ints.Insert(int(i));
+        ASSERT_EQ(h_ints.Insert(int(i - 1)), h_ints.end());
+        ASSERT_EQ(h_ints.Search(i - 1000), h_ints.end());
+        ASSERT_EQ(*h_ints.Search(i - 500), i - 500);
+    }
+
+    ASSERT_EQ(h_ints.Size(), 1000);
+    ASSERT_EQ(h_ints.Capacity(), CAPACITY);
+
+    int num_values = 0;
+    for(int value : h_ints){
+        ASSERT_GE(value, 199000);
+        num_values++;
+    }
+    ASSERT_EQ(num_values, 1000);
+}
+
+TEST(HashTable, TestIncrementalResize){
+    HashTable<string, hash<string>, allocator<string>, true, false, true> h_strings;
+    const int NUM_VALUES = 20000;
+    bool seen_migration = false;
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_strings.Insert(to_string(i));
+        auto it_duplicate = h_strings.Insert(to_string(i));
+        ASSERT_EQ(it_duplicate, h_strings.end());
+
+        if(h_strings.IsMigrating() && !seen_migration){
+            seen_migration = true;
+
+            /* Values on both sides of the migration are found and iterated. */
+            for(int j = 0;j < i;j++){
+                auto it = h_strings.Search(to_string(j));
+                if(j % 3 == 0){
+                    ASSERT_EQ(it, h_strings.end());
+                }else{
+                    ASSERT_EQ(*it, to_string(j));
+                }
+            }
+
+            set<string> values;
+            for(auto it = h_strings.begin(); it != h_strings.end(); ++it){
+                values.insert(*it);
+            }
+            ASSERT_EQ(values.size(), h_strings.Size());
+
+            uint32_t num_values = 0;
+            for(auto it = h_strings.end(); it != h_strings.begin(); --it){
+                num_values++;
+            }
+            ASSERT_EQ(num_values, h_strings.Size());
+        }
+
+        /* Erase while cells are being moved. */
+        if(i % 3 == 0){
+            ASSERT_TRUE(h_strings.Erase(h_strings.Search(to_string(i))));
+        }
+    }
+    ASSERT_TRUE(seen_migration);
+
+    for(int i = 0;i < NUM_VALUES;i++){
+        auto it = h_strings.Search(to_string(i));
+        if(i % 3 == 0){
+            ASSERT_EQ(it, h_strings.end());
+        }else{
+            ASSERT_EQ(*it, to_string(i));
+        }
+    }
+    ASSERT_EQ(h_strings.Size(), NUM_VALUES - (NUM_VALUES + 2) / 3);
+}
+
+TEST(HashTable, TestSparseIteration){
+    HashTable<int> h_ints(100000);
+    for(int i = 0;i < 1000;i++){
+        h_ints.Insert(int(i));
+    }
+    for(int i = 0;i < 1000;i++){
+        if(i % 100 != 7){
+            h_ints.Erase(h_ints.Search(i));
+        }
+    }
+    ASSERT_EQ(h_ints.Size(), 10);
+
+    set<int> values;
+    for(int value : h_ints){
+        values.insert(value);
+    }
+    ASSERT_EQ(values.size(), 10);
+    for(int value : values){
+        ASSERT_EQ(value % 100, 7);
+    }
+
+    set<int> values_backward;
+    for(auto it = h_ints.end(); it != h_ints.begin();){
+        --it;
+        values_backward.insert(*it);
+    }
+    ASSERT_EQ(values_backward, values);
+
+    h_ints.Clear();
+    ASSERT_EQ(h_ints.begin(), h_ints.end());
+}
+
+TEST(HashTable, TestBatch){
+    HashTable<string> h_strings;
+    const uint32_t NUM_VALUES = 1000;
+
+    /* Duplicates inside a batch and against the table are skipped. */
+    vector<string> values;
+    for(uint32_t i = 0;i < NUM_VALUES;i++){
+        values.push_back(to_string(i % (NUM_VALUES / 2)));
+    }
+    ASSERT_EQ(h_strings.InsertBatch(values.data(), values.size()), NUM_VALUES / 2);
+    ASSERT_EQ(h_strings.Size(), NUM_VALUES / 2);
+
+    vector<string> more = {"0", "new"};
+    ASSERT_EQ(h_strings.InsertBatch(more.data(), more.size()), 1);
+
+    vector<string> keys;
+    for(uint32_t i = 0;i < NUM_VALUES;i++){
+        keys.push_back(to_string(i));
+    }
+    vector<HashTable<string>::iterator> results(keys.size(), h_strings.end());
+    h_strings.SearchBatch(keys.data(), keys.size(), results.data());
+    for(uint32_t i = 0;i < NUM_VALUES;i++){
+        if(i < NUM_VALUES / 2){
+            ASSERT_EQ(*results[i], keys[i]);
+        }else{
+            ASSERT_EQ(results[i], h_strings.end());
+        }
+    }
+}
+
+/* Counts how many mapped values were ever built. */
+struct CountedValue{
+    static int constructed;
+    int value;
+
+    explicit CountedValue(int i_value) : value(i_value){
+        constructed++;
+    }
+
+    CountedValue(const CountedValue& other) : value(other.value){
+        constructed++;
+    }
+};
+
+int CountedValue::constructed = 0;
+
+TEST(HashMap, TestTryEmplace){
+    HashMap<string, CountedValue> h_map;
+    CountedValue::constructed = 0;
+
+    auto res = h_map.try_emplace("one", 1);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first->first, "one");
+    ASSERT_EQ(res.first->second.value, 1);
+    ASSERT_EQ(CountedValue::constructed, 1);
+
+    /* The key is present, so no value is built and the old one stays. */
+    auto res_duplicate = h_map.try_emplace("one", 2);
+    ASSERT_FALSE(res_duplicate.second);
+    ASSERT_EQ(res_duplicate.first, res.first);
+    ASSERT_EQ(res_duplicate.first->second.value, 1);
+    ASSERT_EQ(CountedValue::constructed, 1);
+    ASSERT_EQ(h_map.Size(), 1);
+}
+
+TEST(HashMap, TestEmplace){
+    HashMap<string, int> h_map;
+    ASSERT_TRUE(h_map.emplace(string("a"), 1).second);
+    ASSERT_TRUE(h_map.emplace("b", 2).second);
+    ASSERT_TRUE(h_map.emplace(make_pair(string("c"), 3)).second);
+    ASSERT_FALSE(h_map.emplace(string("a"), 10).second);
+    ASSERT_FALSE(h_map.emplace("b", 20).second);
+
+    ASSERT_EQ(h_map.Size(), 3);
+    ASSERT_EQ(h_map.Search("a")->second, 1);
+    ASSERT_EQ(h_map.Search("b")->second, 2);
+    ASSERT_EQ(h_map.Search("c")->second, 3);
+}
+
+TEST(HashMap, TestSubscript){
+    HashMap<int, int> h_map;
+    const int NUM_VALUES = 10000;
+    for(int i = 0;i < NUM_VALUES;i++){
+        h_map[i % 100] += i;
+    }
+    ASSERT_EQ(h_map.Size(), 100);
+
+    for(int i = 0;i < 100;i++){
+        int sum = 0;
+        for(int j = i;j < NUM_VALUES;j += 100){
+            sum += j;
+        }
+        ASSERT_EQ(h_map[i], sum);
+    }
+    ASSERT_EQ(h_map.Size(), 100);
+
+    uint32_t num_values = 0;
+    for(auto& value : h_map){
+        value.second = 0;
+        num_values++;
+    }
+    ASSERT_EQ(num_values, 100);
+    ASSERT_EQ(h_map.Search(42)->second, 0);
+}
+
+TEST(HashMap, TestEraseByKey){
+    HashMap<int, string> h_map;
+    for(int i = 0;i < 1000;i++){
+        h_map.try_emplace(i, to_string(i));
+    }
+
+    for(int i = 0;i < 1000;i += 2){
+        ASSERT_TRUE(h_map.Erase(i));
+    }
+    ASSERT_FALSE(h_map.Erase(0));
+    ASSERT_EQ(h_map.Size(), 500);
+
+    for(int i = 0;i < 1000;i++){
+        auto it = h_map.Search(i);
+        if(i % 2 == 0){
+            ASSERT_EQ(it, h_map.end());
+        }else{
+            ASSERT_EQ(it->second, to_string(i));
+        }
+    }
+}
+
+struct StringHash{
+    using is_transparent = void;
+
+    size_t operator()(string_view value) const{
+        return hash<string_view>{}(value);
+    }
+};
+
+TEST(HashMap, TestHeterogeneousSearch){
+    HashMap<string, int, StringHash, equal_to<>> h_map;
+    h_map.try_emplace("apple", 1);
+    h_map.try_emplace("pear", 2);
+
+    string_view key = "apple";
+    ASSERT_EQ(h_map.Search(key)->second, 1);
+    ASSERT_EQ(h_map.Search("pear")->second, 2);
+    ASSERT_EQ(h_map.Search(string_view("plum")), h_map.end());
+}
+
+TEST(HashMap, TestCustomAllocator){
+    HashMap<int, string, hash<int>, equal_to<int>, CustomAllocator<pair<const int, string>, 1 << 20>> h_map;
+    for(int i = 0;i < 1000;i++){
+        h_map[i] = to_string(i);
+    }
+
+    ASSERT_EQ(h_map.Size(), 1000);
+    ASSERT_EQ(h_map.Search(999)->second, "999");
+}
+
+TEST(HashMap, TestIncrementalResize){
+    HashMap<int, int, hash<int>, equal_to<int>, allocator<pair<const int, int>>, true, true, true> h_map;
+    for(int i = 0;i < 20000;i++){
+        h_map[i] = i * 2;
+    }
+
+    ASSERT_EQ(h_map.Size(), 20000);
+    for(int i = 0;i < 20000;i++){
+        ASSERT_EQ(h_map.Search(i)->second, i * 2);
+    }
+}
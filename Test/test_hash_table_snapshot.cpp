@@ -0,0 +1,127 @@
+#include "hash_table_snapshot.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <set>
+#include <string>
+
+using namespace std;
+
+struct Point{
+    int32_t x;
+    int32_t y;
+
+    bool operator==(const Point& other) const{
+        return x == other.x && y == other.y;
+    }
+};
+
+struct PointHash{
+    size_t operator()(const Point& point) const{
+        return ((uint64_t)(uint32_t)point.x << 32) | (uint32_t)point.y;
+    }
+};
+
+TEST(HashTableSnapshot, TestMapped){
+    const char* PATH = "test_snapshot_mapped.bin";
+    const int NUM_VALUES = 100000;
+    {
+        HashTable<int> h_ints;
+        for(int i = 0;i < NUM_VALUES;i++){
+            h_ints.Insert(i * 3);
+        }
+        ASSERT_TRUE(SaveHashTable(h_ints, PATH));
+    }
+
+    MappedHashTable<int> mapped;
+    ASSERT_TRUE(mapped.Open(PATH));
+    ASSERT_EQ(mapped.Size(), NUM_VALUES);
+    for(int i = 0;i < NUM_VALUES * 3;i++){
+        auto it = mapped.Search(i);
+        if(i % 3 == 0){
+            ASSERT_EQ(*it, i);
+        }else{
+            ASSERT_EQ(it, mapped.end());
+        }
+    }
+
+    set<int> values;
+    for(int value : mapped){
+        values.insert(value);
+    }
+    ASSERT_EQ(values.size(), NUM_VALUES);
+
+    mapped.Close();
+    ASSERT_FALSE(mapped.IsOpen());
+    ASSERT_EQ(mapped.Search(3), mapped.end());
+    remove(PATH);
+}
+
+TEST(HashTableSnapshot, TestMappedStruct){
+    const char* PATH = "test_snapshot_struct.bin";
+    {
+        HashTable<Point, PointHash> h_points;
+        for(int i = 0;i < 100;i++){
+            h_points.Insert(Point{i, -i});
+        }
+        ASSERT_TRUE(SaveHashTable(h_points, PATH));
+    }
+
+    MappedHashTable<Point, PointHash> mapped;
+    ASSERT_TRUE(mapped.Open(PATH));
+    ASSERT_NE(mapped.Search(Point{42, -42}), mapped.end());
+    ASSERT_EQ(mapped.Search(Point{42, 42}), mapped.end());
+
+    /* A snapshot of values of another size is refused. */
+    MappedHashTable<int32_t> mapped_other;
+    ASSERT_FALSE(mapped_other.Open(PATH));
+    remove(PATH);
+}
+
+TEST(HashTableSnapshot, TestLoad){
+    const char* PATH = "test_snapshot_load.bin";
+    HashTable<int> h_ints;
+    for(int i = 0;i < 1000;i++){
+        h_ints.Insert(int(i));
+    }
+    ASSERT_TRUE(SaveHashTable(h_ints, PATH));
+
+    HashTable<int> h_loaded;
+    ASSERT_TRUE(LoadHashTable(h_loaded, PATH));
+    ASSERT_EQ(h_loaded.Size(), 1000);
+    for(int i = 0;i < 1000;i++){
+        ASSERT_EQ(*h_loaded.Search(i), i);
+    }
+    remove(PATH);
+}
+
+TEST(HashTableSnapshot, TestStrings){
+    const char* PATH = "test_snapshot_strings.bin";
+    HashTable<string> h_strings;
+    for(int i = 0;i < 1000;i++){
+        h_strings.Insert(string(i % 50, 'x') + to_string(i));
+    }
+    h_strings.Insert("");
+    ASSERT_TRUE(SaveHashTable(h_strings, PATH));
+
+    /* Strings are streamed, not mapped. */
+    HashTable<string> h_loaded;
+    ASSERT_TRUE(LoadHashTable(h_loaded, PATH));
+    ASSERT_EQ(h_loaded.Size(), h_strings.Size());
+    for(const string& value : h_strings){
+        ASSERT_EQ(*h_loaded.Search(value), value);
+    }
+
+    HashTable<int> h_ints;
+    ASSERT_FALSE(LoadHashTable(h_ints, PATH));
+    MappedHashTable<int> mapped;
+    ASSERT_FALSE(mapped.Open(PATH));
+    remove(PATH);
+}
+
+TEST(HashTableSnapshot, TestMissingFile){
+    MappedHashTable<int> mapped;
+    ASSERT_FALSE(mapped.Open("no_such_snapshot.bin"));
+
+    HashTable<int> h_ints;
+    ASSERT_FALSE(LoadHashTable(h_ints, "no_such_snapshot.bin"));
+}
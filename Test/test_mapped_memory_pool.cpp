@@ -0,0 +1,108 @@
+#include "mapped_memory_pool.h"
+#include "custom_allocator.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <map>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/* Number of pages of [p, p + size) that are resident. */
+static size_t ResidentPages(void* p, size_t size){
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)p & ~(page_size - 1);
+    size_t num_pages = ((uintptr_t)p + size - begin + page_size - 1) / page_size;
+    vector<unsigned char> pages(num_pages);
+    if(mincore((void*)begin, num_pages * page_size, pages.data()) != 0)
+        return 0;
+
+    size_t num_resident = 0;
+    for(unsigned char page : pages){
+        num_resident += page & 1;
+    }
+    return num_resident;
+}
+
+TEST(MappedMemoryPool, TestRuntimeSize){
+    for(uint32_t size_pool : {1u << 12, 3u << 20, 1u << 28}){
+        MappedMemoryPool<> mem_pool(size_pool);
+        ASSERT_EQ(mem_pool.GetFreeBytes(), size_pool - 2 * mem_pool.SIZE_BLOCK_INFO);
+
+        void* p = mem_pool.Alloc(size_pool / 2);
+        ASSERT_NE(p, nullptr);
+        memset(p, 0xAB, size_pool / 2);
+        ASSERT_EQ(mem_pool.Alloc(size_pool), nullptr);
+        mem_pool.Free(p);
+    }
+}
+
+TEST(MappedMemoryPool, TestPopulate){
+    const uint32_t SIZE_POOL = 8 << 20;
+    MappedMemoryPool<> mem_pool(SIZE_POOL, MAPPED_POOL_POPULATE);
+    void* p = mem_pool.Alloc(SIZE_POOL / 2);
+    ASSERT_GE(ResidentPages(p, SIZE_POOL / 2), (SIZE_POOL / 2) / sysconf(_SC_PAGESIZE));
+    mem_pool.Free(p);
+}
+
+TEST(MappedMemoryPool, TestHugePages){
+    /* Explicit huge pages are seldom reserved, the pool then falls back to
+    transparent ones and works the same. */
+    const uint32_t SIZE_POOL = 16 << 20;
+    for(uint32_t options : {MAPPED_POOL_HUGETLB, MAPPED_POOL_TRANSPARENT_HUGE_PAGES,
+                            MAPPED_POOL_HUGETLB | MAPPED_POOL_POPULATE}){
+        MappedMemoryPool<256> mem_pool(SIZE_POOL, options);
+        vector<void*> blocks;
+        for(int i = 0;i < 1000;i++){
+            void* p = mem_pool.Alloc(1000);
+            ASSERT_NE(p, nullptr);
+            memset(p, i, 1000);
+            blocks.push_back(p);
+        }
+        for(void* p : blocks){
+            mem_pool.Free(p);
+        }
+        ASSERT_EQ(mem_pool.GetAllocatedBlocks(), 0);
+    }
+}
+
+TEST(MappedMemoryPool, TestReleaseFreePages){
+    const uint32_t SIZE_POOL = 32 << 20;
+    MappedMemoryPool<> mem_pool(SIZE_POOL);
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    uint8_t* p_large = (uint8_t*)mem_pool.Alloc(16 << 20);
+    void* p_small = mem_pool.Alloc(64);
+    memset(p_large, 1, 16 << 20);
+    ASSERT_GT(ResidentPages(p_large, 16 << 20), 0);
+
+    /* Small free blocks are left alone. */
+    mem_pool.Free(p_large);
+    ASSERT_EQ(mem_pool.ReleaseFreePages(32 << 20), 0);
+
+    size_t size_released = mem_pool.ReleaseFreePages();
+    ASSERT_GE(size_released, (16u << 20) - 2 * sysconf(_SC_PAGESIZE));
+    ASSERT_LE(ResidentPages(p_large, 16 << 20), 2);
+
+    /* The released space is as good as any other. */
+    uint8_t* p = (uint8_t*)mem_pool.Alloc(16 << 20);
+    ASSERT_EQ(p, p_large);
+    ASSERT_EQ(p[1 << 20], 0);
+    mem_pool.Free(p);
+    mem_pool.Free(p_small);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+}
+
+TEST(MappedMemoryPool, TestPoolAllocator){
+    using Pool = MappedMemoryPool<256>;
+    Pool pool(1 << 20);
+    {
+        map<int, int, less<int>, PoolAllocator<pair<const int, int>, Pool>> dict{PoolAllocator<pair<const int, int>, Pool>(pool)};
+        for(int i = 0;i < 1000;i++){
+            dict[i] = i;
+        }
+        ASSERT_EQ(dict.size(), 1000);
+        ASSERT_NE(pool.GetAllocatedBlocks(), 0);
+    }
+    ASSERT_EQ(pool.GetAllocatedBlocks(), 0);
+}
@@ -1,5 +1,9 @@
 #include "memory_pool.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
 
 TEST(MemoryPool, CheckSizePool){
     {
@@ -64,3 +68,382 @@ TEST(MemoryPool, CheckSizePool){
         ASSERT_EQ(mem_pool.GetFreeBytes(), 2 * SIZE_B_INF + 3 * ALLOC_SIZE);
     }    
 }
+
+
+TEST(MemoryPool, SizeClassReuse){
+    const uint32_t SIZE_B_INF = MemoryPool<47>::SIZE_BLOCK_INFO;
+    const uint32_t SIZE_POOL = 1024;
+    MemoryPool<SIZE_POOL, 64> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    void* p_small = mem_pool.Alloc(24);
+    void* p_other = mem_pool.Alloc(24);
+    ASSERT_NE(p_small, nullptr);
+    ASSERT_NE(p_other, nullptr);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES - 2 * (SIZE_B_INF + 24));
+
+    /* Cached blocks are counted as free, but are not merged. */
+    mem_pool.Free(p_small);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES - SIZE_B_INF * 2 - 24);
+
+    /* Double free of a cached block is ignored. */
+    mem_pool.Free(p_small);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES - SIZE_B_INF * 2 - 24);
+
+    /* A request of the same class gets the cached block back. */
+    void* p_again = mem_pool.Alloc(20);
+    ASSERT_EQ(p_again, p_small);
+
+    mem_pool.Free(p_again);
+    mem_pool.Free(p_other);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES - SIZE_B_INF * 2);
+}
+
+TEST(MemoryPool, SizeClassFlush){
+    const uint32_t SIZE_POOL = 1024;
+    MemoryPool<SIZE_POOL, 64> mem_pool;
+
+    std::vector<void*> blocks;
+    for(void* p = mem_pool.Alloc(8); p != nullptr; p = mem_pool.Alloc(8)){
+        blocks.push_back(p);
+    }
+    ASSERT_GT(blocks.size(), 1);
+
+    for(void* p : blocks){
+        mem_pool.Free(p);
+    }
+
+    /* Nothing in the coalescing list is large enough, so the cached blocks
+    have to be merged back before the request can be served. */
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+    void* p_large = mem_pool.Alloc(SIZE_POOL / 2);
+    ASSERT_NE(p_large, nullptr);
+
+    mem_pool.Free(p_large);
+    ASSERT_GT(mem_pool.GetFreeBytes(), FREE_BYTES);
+    ASSERT_NE(mem_pool.Alloc(mem_pool.GetFreeBytes()), nullptr);
+}
+
+TEST(MemoryPool, CoalesceAnyOrder){
+    const uint32_t SIZE_POOL = 4096;
+    MemoryPool<SIZE_POOL> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    std::vector<void*> blocks;
+    for(uint32_t i = 0;i < 32;i++){
+        void* p = mem_pool.Alloc(8 + (i % 5) * 24);
+        ASSERT_NE(p, nullptr);
+        blocks.push_back(p);
+    }
+
+    /* Free odd blocks first, so that every even block is later merged with
+    neighbours on both sides. */
+    for(size_t i = 1;i < blocks.size();i += 2){
+        mem_pool.Free(blocks[i]);
+    }
+    for(size_t i = 0;i < blocks.size();i += 2){
+        mem_pool.Free(blocks[i]);
+    }
+
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+    ASSERT_NE(mem_pool.Alloc(FREE_BYTES), nullptr);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), 0);
+}
+
+TEST(MemoryPool, AlignedAlloc){
+    const uint32_t SIZE_POOL = 16384;
+    MemoryPool<SIZE_POOL> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    std::vector<void*> blocks;
+    for(uint32_t alignment : {8u, 16u, 32u, 64u, 4096u}){
+        /* Misalign the next free block before each aligned request. */
+        void* p_pad = mem_pool.Alloc(8);
+        ASSERT_NE(p_pad, nullptr);
+        blocks.push_back(p_pad);
+
+        void* p = mem_pool.AllocAligned(100, alignment);
+        ASSERT_NE(p, nullptr);
+        ASSERT_EQ((uintptr_t)p % alignment, 0);
+        ASSERT_GE(mem_pool.GetBlockSize(p), 100);
+        memset(p, 0xA5, 100);
+        blocks.push_back(p);
+    }
+
+    void* p = mem_pool.Alloc(64, std::align_val_t(64));
+    ASSERT_NE(p, nullptr);
+    ASSERT_EQ((uintptr_t)p % 64, 0);
+    blocks.push_back(p);
+
+    for(void* p_block : blocks){
+        mem_pool.Free(p_block);
+    }
+
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+    ASSERT_NE(mem_pool.Alloc(FREE_BYTES), nullptr);
+}
+
+TEST(MemoryPool, AlignedAllocOverhead){
+    const uint32_t SIZE_POOL = 4096;
+    MemoryPool<SIZE_POOL> mem_pool;
+    const uint32_t SIZE_BLOCK_INFO = mem_pool.SIZE_BLOCK_INFO;
+
+    /* The space in front of an aligned payload stays free, so it costs one
+    block header and nothing else. */
+    void* p_pad = mem_pool.Alloc(24);
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+    void* p = mem_pool.AllocAligned(64, 64);
+    ASSERT_NE(p, nullptr);
+    ASSERT_EQ((uintptr_t)p % 64, 0);
+    ASSERT_EQ(mem_pool.GetBlockSize(p), 64);
+    ASSERT_GE(mem_pool.GetFreeBytes(), FREE_BYTES - 64 - 2 * SIZE_BLOCK_INFO);
+
+    /* The leading free block is merged back on Free. */
+    mem_pool.Free(p);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+    mem_pool.Free(p_pad);
+}
+
+TEST(MemoryPool, ExpandAndShrinkInPlace){
+    const uint32_t SIZE_POOL = 4096;
+    MemoryPool<SIZE_POOL> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    void* p = mem_pool.Alloc(64);
+    void* p_next = mem_pool.Alloc(64);
+    void* p_last = mem_pool.Alloc(64);
+    ASSERT_NE(p_last, nullptr);
+
+    /* The neighbour is allocated. */
+    ASSERT_FALSE(mem_pool.TryExpand(p, 128));
+    ASSERT_EQ(mem_pool.GetBlockSize(p), 64);
+
+    mem_pool.Free(p_next);
+    const uint32_t FREE_BEFORE = mem_pool.GetFreeBytes();
+    ASSERT_TRUE(mem_pool.TryExpand(p, 100));
+    ASSERT_GE(mem_pool.GetBlockSize(p), 100);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BEFORE - (mem_pool.GetBlockSize(p) - 64));
+    ASSERT_FALSE(mem_pool.TryExpand(p, 256));
+
+    /* The tail goes back and merges with the free space after it. */
+    mem_pool.Shrink(p, 8);
+    ASSERT_EQ(mem_pool.GetBlockSize(p), 8);
+    ASSERT_TRUE(mem_pool.TryExpand(p, 144));
+
+    mem_pool.Free(p);
+    mem_pool.Free(p_last);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+    ASSERT_EQ(mem_pool.GetAllocatedBlocks(), 0);
+}
+
+TEST(MemoryPool, Realloc){
+    const uint32_t SIZE_POOL = 4096;
+    MemoryPool<SIZE_POOL> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    void* p_first = mem_pool.Alloc(256);
+    uint8_t* p = (uint8_t*)mem_pool.Alloc(64);
+    void* p_last = mem_pool.Alloc(64);
+    for(uint32_t i = 0;i < 64;i++){
+        p[i] = (uint8_t)i;
+    }
+
+    /* Both neighbours are allocated, the block has to move. */
+    uint8_t* p_moved = (uint8_t*)mem_pool.Realloc(p, 128);
+    ASSERT_NE(p_moved, nullptr);
+    ASSERT_NE(p_moved, p);
+    for(uint32_t i = 0;i < 64;i++){
+        ASSERT_EQ(p_moved[i], (uint8_t)i);
+    }
+
+    mem_pool.Free(p_first);
+    mem_pool.Free(p_moved);
+    mem_pool.Free(p_last);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+
+    /* Only the space in front is free now, the payload slides down into it. */
+    p_first = mem_pool.Alloc(256);
+    p = (uint8_t*)mem_pool.Alloc(64);
+    p_last = mem_pool.Alloc(64);
+    for(uint32_t i = 0;i < 64;i++){
+        p[i] = (uint8_t)i;
+    }
+    mem_pool.Free(p_first);
+    p_moved = (uint8_t*)mem_pool.Realloc(p, 200);
+    ASSERT_EQ(p_moved, (uint8_t*)p_first);
+    for(uint32_t i = 0;i < 64;i++){
+        ASSERT_EQ(p_moved[i], (uint8_t)i);
+    }
+
+    /* Shrinking never moves. */
+    ASSERT_EQ(mem_pool.Realloc(p_moved, 16), p_moved);
+    ASSERT_EQ(mem_pool.Realloc(p_moved, SIZE_POOL), nullptr);
+
+    mem_pool.Free(p_moved);
+    mem_pool.Free(p_last);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+    ASSERT_EQ(mem_pool.GetAllocatedBlocks(), 0);
+}
+
+TEST(MemoryPool, Stats){
+    const uint32_t SIZE_POOL = 4096;
+    MemoryPool<SIZE_POOL, 0, true> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    void* p_small = mem_pool.Alloc(8);
+    void* p_mid = mem_pool.Alloc(100);
+    void* p_large = mem_pool.Alloc(1000);
+    ASSERT_EQ(mem_pool.Alloc(SIZE_POOL), nullptr);
+
+    MemoryPoolStats stats = mem_pool.GetStats();
+    ASSERT_EQ(stats.alloc_count, 3);
+    ASSERT_EQ(stats.failed_allocs, 1);
+    ASSERT_EQ(stats.allocs_by_size[3], 1);
+    ASSERT_EQ(stats.allocs_by_size[7], 1);
+    ASSERT_EQ(stats.allocs_by_size[10], 1);
+    ASSERT_EQ(stats.used_bytes, FREE_BYTES - mem_pool.GetFreeBytes());
+    ASSERT_EQ(stats.peak_used_bytes, stats.used_bytes);
+    ASSERT_EQ(stats.free_list_length, 1);
+    ASSERT_EQ(stats.largest_free_block, mem_pool.GetFreeBytes());
+    ASSERT_EQ(stats.Fragmentation(), 0.0);
+
+    /* The hole left by p_mid cannot merge with the tail of the pool. */
+    mem_pool.Free(p_mid);
+    stats = mem_pool.GetStats();
+    ASSERT_EQ(stats.free_count, 1);
+    ASSERT_EQ(stats.free_list_length, 2);
+    ASSERT_LT(stats.used_bytes, stats.peak_used_bytes);
+    ASSERT_GT(stats.Fragmentation(), 0.0);
+    ASSERT_LT(stats.Fragmentation(), 1.0);
+
+    mem_pool.Free(p_small);
+    mem_pool.Free(p_large);
+    stats = mem_pool.GetStats();
+    ASSERT_EQ(stats.used_bytes, 0);
+    ASSERT_EQ(stats.free_list_length, 1);
+    ASSERT_EQ(stats.largest_free_block, FREE_BYTES);
+
+    std::string json = stats.ToJson();
+    ASSERT_NE(json.find("\"alloc_count\":3"), std::string::npos);
+    ASSERT_NE(json.find("\"failed_allocs\":1"), std::string::npos);
+    ASSERT_NE(json.find("\"allocs_by_size\":{\"8\":1,\"128\":1,\"1024\":1}"), std::string::npos);
+}
+
+TEST(MemoryPool, StatsOff){
+    MemoryPool<1024> mem_pool;
+    void* p = mem_pool.Alloc(64);
+
+    MemoryPoolStats stats = mem_pool.GetStats();
+    ASSERT_EQ(stats.alloc_count, 0);
+    ASSERT_EQ(stats.free_bytes, mem_pool.GetFreeBytes());
+    ASSERT_EQ(stats.free_list_length, 1);
+    mem_pool.Free(p);
+}
+
+TEST(MemoryPool, CompactHeadersDensity){
+    const uint32_t SIZE_POOL = 1 << 16;
+    MemoryPool<SIZE_POOL> wide_pool;
+    MemoryPool<SIZE_POOL, 0, false, true> compact_pool;
+    const uint32_t SIZE_B_INF = MemoryPool<SIZE_POOL, 0, false, true>::SIZE_BLOCK_INFO;
+    ASSERT_EQ(SIZE_B_INF, 8);
+
+    uint32_t num_wide = 0;
+    while(wide_pool.Alloc(16) != nullptr){
+        num_wide++;
+    }
+    uint32_t num_compact = 0;
+    while(compact_pool.Alloc(16) != nullptr){
+        num_compact++;
+    }
+
+    /* 24 instead of 32 bytes per object. */
+    ASSERT_EQ(num_wide, (SIZE_POOL - 16) / 32);
+    ASSERT_EQ(num_compact, (SIZE_POOL - 8) / 24);
+}
+
+template<uint32_t SIZE_CLASS_LIMIT>
+void CheckCompactChurn(){
+    const uint32_t SIZE_POOL = 1 << 18;
+    MemoryPool<SIZE_POOL, SIZE_CLASS_LIMIT, false, true> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    /* Every block is filled with a pattern of its own, which the links of
+    neighbouring free blocks must never touch. */
+    struct Block{
+        uint8_t* p;
+        uint32_t size;
+    };
+    std::vector<Block> live(256, Block{nullptr, 0});
+    uint64_t state = 12345;
+    for(uint32_t i = 0;i < 100000;i++){
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t r = (uint32_t)(state >> 33);
+        Block& block = live[r % live.size()];
+
+        if(block.p != nullptr){
+            for(uint32_t j = 0;j < block.size;j++){
+                ASSERT_EQ(block.p[j], (uint8_t)((uintptr_t)block.p + j));
+            }
+        }
+
+        uint32_t size = (r >> 8) % 4 == 0 ? (r >> 10) % 2000 : (r >> 10) % 40;
+        if((r >> 20) % 3 == 0 && block.p != nullptr){
+            uint8_t* p_new = (uint8_t*)mem_pool.Realloc(block.p, size);
+            if(p_new == nullptr)
+                continue;
+            for(uint32_t j = 0;j < std::min(size, block.size);j++){
+                ASSERT_EQ(p_new[j], (uint8_t)((uintptr_t)block.p + j));
+            }
+            block.p = p_new;
+        }
+        else{
+            mem_pool.Free(block.p);
+            block.p = (uint8_t*)mem_pool.Alloc(size);
+            if(block.p == nullptr)
+                continue;
+        }
+
+        block.size = size;
+        ASSERT_EQ((uintptr_t)block.p % 8, 0);
+        ASSERT_GE(mem_pool.GetBlockSize(block.p), size);
+        for(uint32_t j = 0;j < size;j++){
+            block.p[j] = (uint8_t)((uintptr_t)block.p + j);
+        }
+    }
+
+    for(Block& block : live){
+        mem_pool.Free(block.p);
+        /* A second free of the same block is ignored. */
+        mem_pool.Free(block.p);
+    }
+    ASSERT_EQ(mem_pool.GetAllocatedBlocks(), 0);
+
+    /* Cached blocks go back to the coalescing list when a large request
+    needs them, after which the pool is one block again. */
+    void* p_all = mem_pool.Alloc(FREE_BYTES);
+    ASSERT_NE(p_all, nullptr);
+    mem_pool.Free(p_all);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+}
+
+TEST(MemoryPool, CompactHeadersChurn){
+    CheckCompactChurn<0>();
+}
+
+TEST(MemoryPool, CompactHeadersSizeClasses){
+    CheckCompactChurn<256>();
+}
+
+TEST(MemoryPool, CompactHeadersAligned){
+    MemoryPool<4096, 0, false, true> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    void* p_small = mem_pool.Alloc(8);
+    void* p_aligned = mem_pool.AllocAligned(100, 256);
+    ASSERT_NE(p_aligned, nullptr);
+    ASSERT_EQ((uintptr_t)p_aligned % 256, 0);
+
+    mem_pool.Free(p_small);
+    mem_pool.Free(p_aligned);
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+}
@@ -0,0 +1,81 @@
+#include "memory_resource.h"
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+TEST(MemoryPoolResource, PmrContainers){
+    MemoryPool<1 << 16, 256> mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+    MemoryPoolResource<MemoryPool<1 << 16, 256>> resource(mem_pool);
+
+    {
+        pmr::vector<int> values(&resource);
+        pmr::map<int, pmr::string> names(&resource);
+        for(int i = 0;i < 100;i++){
+            values.push_back(i);
+            names.emplace(i, "a rather long name that does not fit in SSO");
+        }
+
+        ASSERT_EQ(values[99], 99);
+        ASSERT_EQ(names.at(42).size(), 43);
+        ASSERT_LT(mem_pool.GetFreeBytes(), FREE_BYTES);
+    }
+
+    /* Everything went back, the pool may only have kept small blocks on its
+    size class lists. */
+    ASSERT_NE(mem_pool.Alloc(FREE_BYTES), nullptr);
+}
+
+TEST(MemoryPoolResource, Exhausted){
+    MemoryPool<1024> mem_pool;
+    MemoryPoolResource<MemoryPool<1024>> resource(mem_pool);
+
+    pmr::vector<int> values(&resource);
+    ASSERT_THROW(values.reserve(1024), bad_alloc);
+}
+
+TEST(MemoryPoolResource, OverAligned){
+    MemoryPool<4096> mem_pool;
+    MemoryPoolResource<MemoryPool<4096>> resource(mem_pool);
+
+    void* p = resource.allocate(100, 64);
+    ASSERT_EQ((uintptr_t)p % 64, 0);
+    resource.deallocate(p, 100, 64);
+}
+
+TEST(MonotonicArenaResource, BumpAndRelease){
+    MemoryPool<1 << 16> mem_pool;
+    MemoryPoolResource<MemoryPool<1 << 16>> pool_resource(mem_pool);
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    {
+        MonotonicArenaResource arena(1024, &pool_resource);
+
+        void* p_first = arena.allocate(24, 8);
+        void* p_second = arena.allocate(24, 8);
+        ASSERT_EQ((uint8_t*)p_second - (uint8_t*)p_first, 24);
+
+        void* p_aligned = arena.allocate(64, 64);
+        ASSERT_EQ((uintptr_t)p_aligned % 64, 0);
+
+        /* deallocate is a no-op. */
+        arena.deallocate(p_second, 24, 8);
+        ASSERT_NE(arena.allocate(24, 8), p_second);
+
+        /* Outgrow the first buffer. */
+        pmr::vector<int> values(&arena);
+        for(int i = 0;i < 1000;i++){
+            values.push_back(i);
+        }
+        ASSERT_EQ(values[999], 999);
+
+        /* Release rewinds to the start of the first buffer. */
+        arena.Release();
+        ASSERT_EQ(arena.allocate(24, 8), p_first);
+    }
+
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+}
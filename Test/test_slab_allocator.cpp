@@ -0,0 +1,79 @@
+#include "slab_allocator.h"
+#include "custom_allocator.h"
+#include <gtest/gtest.h>
+#include <list>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+TEST(SlabPool, NoHeaderAndReuse){
+    using Pool = MemoryPool<1 << 16>;
+    using Slabs = SlabPool<24, 8, Pool>;
+    const uint32_t SLOT_SIZE = Slabs::SLOT_SIZE;
+    Pool mem_pool;
+    Slabs slab_pool(mem_pool);
+
+    uint8_t* p_first = (uint8_t*)slab_pool.Alloc();
+    uint8_t* p_second = (uint8_t*)slab_pool.Alloc();
+    ASSERT_NE(p_first, nullptr);
+    ASSERT_EQ(p_second - p_first, SLOT_SIZE);
+    ASSERT_EQ(SLOT_SIZE, 24);
+
+    slab_pool.Free(p_first);
+    ASSERT_EQ(slab_pool.Alloc(), p_first);
+}
+
+TEST(SlabPool, SmallBackingPool){
+    using Pool = MemoryPool<1024>;
+    Pool mem_pool;
+    const uint32_t FREE_BYTES = mem_pool.GetFreeBytes();
+
+    {
+        SlabPool<40, 8, Pool> slab_pool(mem_pool);
+
+        /* A full slab does not fit, so the pool is carved into smaller ones. */
+        vector<void*> objects;
+        for(void* p = slab_pool.Alloc(); p != nullptr; p = slab_pool.Alloc()){
+            objects.push_back(p);
+        }
+        ASSERT_GE(objects.size(), 20);
+
+        for(void* p : objects){
+            slab_pool.Free(p);
+        }
+    }
+
+    /* The slabs go back to the pool with the slab pool. */
+    ASSERT_EQ(mem_pool.GetFreeBytes(), FREE_BYTES);
+}
+
+TEST(SlabPool, OverAligned){
+    using Pool = MemoryPool<1 << 16>;
+    Pool mem_pool;
+    SlabPool<48, 32, Pool> slab_pool(mem_pool);
+
+    for(int i = 0;i < 100;i++){
+        ASSERT_EQ((uintptr_t)slab_pool.Alloc() % 32, 0);
+    }
+}
+
+TEST(SlabPool, NodeContainers){
+    map<int, int, less<int>, CustomAllocator<pair<const int, int>, 1 << 16>> dict;
+    list<int, CustomAllocator<int, 1 << 16>> values;
+
+    for(int i = 0;i < 1000;i++){
+        dict[i] = i * 2;
+        values.push_back(i);
+    }
+
+    for(int i = 0;i < 1000;i += 2){
+        dict.erase(i);
+        values.pop_front();
+    }
+
+    ASSERT_EQ(dict.size(), 500);
+    ASSERT_EQ(values.size(), 500);
+    ASSERT_EQ(dict[999], 1998);
+    ASSERT_EQ(values.front(), 500);
+}